@@ -0,0 +1,108 @@
+/**
+ * Measures parsing a configuration of 100000 verbosities like "app.module17.part3=warning", as
+ * done at startup and on every reload, compared to a chain of string comparisons.
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "einhard.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace einhard;
+
+namespace
+{
+// How levels were parsed before parseLogLevel(): uppercase, then compare to each name
+LogLevel compareNames( std::string level )
+{
+	std::transform( level.begin(), level.end(), level.begin(), []( char c ) { return std::toupper( c ); } );
+	const char *const names[] = {"ALL", "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL", "OFF"};
+	for( int i = 0; i <= OFF; ++i )
+	{
+		if( level == names[i] )
+		{
+			return static_cast<LogLevel>( i );
+		}
+	}
+	return OFF;
+}
+
+template <typename F> double nanosecondsPerSpec( std::size_t specs, int rounds, F f )
+{
+	const auto start = std::chrono::steady_clock::now();
+	for( int i = 0; i < rounds; ++i )
+	{
+		f();
+	}
+	const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count() / rounds / specs;
+}
+}  // unnamed namespace
+
+int main( int argc, char **argv )
+{
+	const std::size_t count = argc > 1 ? std::strtoul( argv[1], nullptr, 10 ) : 100000;
+	const int rounds = 10;
+
+	const char *const names[] = {"trace", "DEBUG", "Info", "warning", "WARN", "error", "err", "FATAL", "off"};
+	std::string config;
+	std::vector<std::string> areas;
+	std::vector<std::string> levels;
+	for( std::size_t i = 0; i < count; ++i )
+	{
+		areas.push_back( "app.module" + std::to_string( i / 16 ) + ".part" + std::to_string( i % 16 ) );
+		levels.push_back( names[i % ( sizeof( names ) / sizeof( names[0] ) )] );
+		config += ( i ? "," : "" ) + areas.back() + '=' + levels.back();
+	}
+
+	unsigned long checksum = 0;
+	const double compared = nanosecondsPerSpec( count, rounds, [&]() {
+		for( const std::string &level : levels )
+		{
+			checksum += compareNames( level );
+		}
+	} );
+	const double parsed = nanosecondsPerSpec( count, rounds, [&]() {
+		for( const std::string &level : levels )
+		{
+			LogLevel result = OFF;
+			parseLogLevel( level, result );
+			checksum += result;
+		}
+	} );
+	const double specs = nanosecondsPerSpec( count, rounds, [&]() {
+		parseLevelSpecs( config, [&]( const char *, std::size_t size, LogLevel level ) { checksum += size + level; } );
+	} );
+	const double applied = nanosecondsPerSpec( count, 1, [&]() { setVerbosities( config ); } );
+	const double reapplied = nanosecondsPerSpec( count, 1, [&]() { setVerbosities( config ); } );
+
+	std::printf( "%s: %zu specs, %zu bytes, checksum %lu\n", argv[0], count, config.size(), checksum );
+	std::printf( "  compare names:     %7.1f ns per level\n", compared );
+	std::printf( "  parseLogLevel:     %7.1f ns per level\n", parsed );
+	std::printf( "  parseLevelSpecs:   %7.1f ns per spec\n", specs );
+	std::printf( "  setVerbosities:    %7.1f ns per spec, first time\n", applied );
+	std::printf( "  setVerbosities:    %7.1f ns per spec, again\n", reapplied );
+	return 0;
+}
+
+// vim: ts=4 sw=4 tw=100 noet
@@ -0,0 +1,107 @@
+/**
+ * Measures the cost per record of enabled and disabled log statements and reports the size of
+ * the executable.
+ *
+ * The same source is built against the Einhard library (recordCost), with the library built for
+ * link time optimization (recordCostLto) and header-only (recordCostHeaderOnly), to compare how
+ * much inlining the implementation into the call site gains.
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "einhard.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include <sys/stat.h>
+
+using namespace einhard;
+
+namespace
+{
+// Discards the records, so only the cost of formatting them is measured
+struct NullSink : public Sink
+{
+	std::size_t bytes = 0;
+
+	void write( const Record &record ) noexcept override
+	{
+		bytes += record.size;
+	}
+};
+
+template <typename F> double nanosecondsPerRecord( long records, F f )
+{
+	const auto start = std::chrono::steady_clock::now();
+	for( long i = 0; i < records; ++i )
+	{
+		f( i );
+	}
+	const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count() / records;
+}
+}  // unnamed namespace
+
+int main( int argc, char **argv )
+{
+	const long records = argc > 1 ? std::atol( argv[1] ) : 1000000;
+
+	NullSink sink;
+	setSink( &sink );
+	Logger<> logger( INFO, false );
+	logger.setAreaName( "bench" );
+	Logger<> colored( INFO, true );
+	colored.setAreaName( "bench" );
+
+	// warm up
+	nanosecondsPerRecord( records / 10 + 1, [&]( long i ) { logger.info() << "record " << i; } );
+
+	const double plain = nanosecondsPerRecord( records, [&]( long i ) { logger.info() << "record " << i; } );
+	const double withColor =
+	    nanosecondsPerRecord( records, [&]( long i ) { colored.warn() << "record " << Red() << i; } );
+	const double multiLine =
+	    nanosecondsPerRecord( records, [&]( long i ) { logger.info() << "record\n" << i; } );
+	double batched;
+	{
+		Batch batch = logger.batch( INFO );
+		batched = nanosecondsPerRecord( records, [&]( long i ) {
+			batch.record() << "record " << i;
+			if( batch.size() == 1000 )
+			{
+				batch.submit();
+			}
+		} );
+	}
+	const double disabled =
+	    nanosecondsPerRecord( records * 10, [&]( long i ) { logger.debug() << "record " << i; } );
+	setSink( nullptr );
+
+	struct stat status;
+	const long long size = stat( "/proc/self/exe", &status ) == 0 ? status.st_size : -1;
+
+	std::printf( "%s: %ld records, %zu bytes formatted\n", argv[0], records, sink.bytes );
+	std::printf( "  enabled:    %7.1f ns per record\n", plain );
+	std::printf( "  colored:    %7.1f ns per record\n", withColor );
+	std::printf( "  multi-line: %7.1f ns per record\n", multiLine );
+	std::printf( "  batched:    %7.1f ns per record\n", batched );
+	std::printf( "  disabled:   %7.2f ns per record\n", disabled );
+	std::printf( "  executable: %lld bytes\n", size );
+	return 0;
+}
+
+// vim: ts=4 sw=4 tw=100 noet
@@ -0,0 +1,147 @@
+/**
+ * @file
+ *
+ * A Sink handing records to a background thread, which writes them to another Sink.
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "einhard.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace einhard
+{
+	/**
+	 * A Sink queueing records for a background thread, which writes them to a target Sink.
+	 *
+	 * Each LogLevel has its own queue (lane). The writer always drains the most severe non-empty
+	 * lane first, so an ERROR does not wait behind a flood of INFO records. Each lane has its own
+	 * capacity and policy for records arriving while it is full. Records of synchronousLevel()
+	 * or higher can bypass the lanes and be written right away by the logging thread.
+	 *
+	 * The target must accept concurrent calls to write() if records bypass the lanes.
+	 *
+	 * Across fork() the parent keeps writing the queued records, while the child starts with empty
+	 * lanes and a writer thread of its own.
+	 */
+	class AsyncSink : public Sink, private ForkHandler
+	{
+	public:
+		/// What happens to a record arriving at a full lane.
+		enum DropPolicy
+		{
+			DROP_NEWEST, /**< The record is dropped */
+			DROP_OLDEST, /**< The oldest queued record of the lane is dropped to make room */
+			BLOCK        /**< The logging thread waits until the writer made room */
+		};
+
+		/// The state of a lane, e.g. for tuning its capacity.
+		struct LaneStats
+		{
+			std::size_t depth;       /**< Records currently queued */
+			std::size_t peakDepth;   /**< The highest depth seen */
+			std::uint64_t written;   /**< Records passed to the target */
+			std::uint64_t dropped;   /**< Records lost to the drop policy or lack of memory */
+			std::uint64_t blocked;   /**< Times a logging thread had to wait for room */
+			std::uint64_t bypassed;  /**< Records written synchronously */
+		};
+
+		/**
+		 * Start the writer thread.
+		 *
+		 * By default the lanes of TRACE, DEBUG and INFO hold 4096 records and drop the oldest
+		 * ones, while the lanes of WARN, ERROR and FATAL hold 4096 records and block.
+		 *
+		 * \param target The Sink the records are written to. It must outlive this object.
+		 * \param synchronousLevel Records of this or a higher severity bypass the lanes. OFF
+		 *                         queues all records.
+		 */
+		explicit AsyncSink( Sink &target, LogLevel synchronousLevel = OFF );
+		AsyncSink( const AsyncSink & ) = delete;
+		AsyncSink &operator=( const AsyncSink & ) = delete;
+		/// Writes all queued records and stops the writer thread.
+		~AsyncSink();
+
+		void write( const Record &record ) noexcept override;
+
+		/**
+		 * Change the capacity and drop policy of the lane of \p level.
+		 *
+		 * Records already queued beyond a reduced capacity are kept.
+		 */
+		void configureLane( LogLevel level, std::size_t capacity, DropPolicy policy );
+		/// Change the severity from which on records bypass the lanes.
+		void setSynchronousLevel( LogLevel level ) noexcept;
+		LogLevel synchronousLevel() const noexcept;
+
+		/// Block until all records queued so far have been written.
+		void flush();
+
+		LaneStats stats( LogLevel level ) const;
+		/// The number of records queued in all lanes or being written.
+		std::size_t depth() const;
+
+	private:
+		struct Entry
+		{
+			// the record without its data, which is kept in data
+			Record record;
+			std::string data;
+		};
+
+		struct Lane
+		{
+			std::deque<Entry> queue;
+			std::size_t capacity;
+			DropPolicy policy;
+			LaneStats stats;
+		};
+
+		static std::size_t laneIndex( LogLevel level ) noexcept;
+		void run();
+		void stop() noexcept;
+
+		void prepareFork() noexcept override;
+		void afterForkInParent() noexcept override;
+		void afterForkInChild() noexcept override;
+
+		Sink &target;
+		std::atomic<int> synchronousLevel_;
+
+		mutable std::mutex mutex;
+		// signalled when records are queued or the writer shall stop
+		std::condition_variable recordsQueued;
+		// signalled when the writer has taken records from the lanes
+		std::condition_variable recordsTaken;
+		Lane lanes[OFF - TRACE];
+		// records taken from the lanes, but not yet written
+		std::size_t inFlight;
+		bool stopping;
+		std::unique_ptr<std::thread> writer;
+	};
+}
+
+// vim: ts=4 sw=4 tw=100 noet
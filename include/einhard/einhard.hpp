@@ -66,7 +66,23 @@
 #include <ctime>
 #include <cstring>
 #include <sstream>
+#include <atomic>
 #include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+#if defined( __cpp_impl_coroutine ) && defined( __has_include )
+#if __has_include( <coroutine> )
+#include <coroutine>
+// Defined if TaskContext::await() is available
+#define EINHARD_HAS_COROUTINES 1
+#endif
+#endif
 
 // This C header is sadly required to check whether writing to a terminal or a file
 #include <cstdio>
@@ -79,6 +95,16 @@
 #define EINHARD_ALWAYS_INLINE_
 #endif
 
+// Define EINHARD_HEADER_ONLY before including Einhard to compile the implementation into the
+// including translation units instead of linking the Einhard library. This allows the compiler to
+// inline and specialise the formatting of records at the call site. All translation units of
+// a program must agree on this setting.
+#ifdef EINHARD_HEADER_ONLY
+#define EINHARD_INLINE_ inline
+#else
+#define EINHARD_INLINE_
+#endif
+
 // Error on MacOS:
 //    “thread-local storage is unsupported for the current target”
 // To enable a workaround the EINHARD_NO_THREAD_LOCAL macro must be defined.
@@ -86,6 +112,20 @@
 #define EINHARD_NO_THREAD_LOCAL 1
 #endif
 
+// A Logger takes two words. Define EINHARD_LOGGER_ALIGNMENT, e.g. to 64, before including Einhard
+// to align Logger objects to (and fill) a cache line of that size instead, so that a Logger
+// embedded in another object never shares a cache line with frequently written data. This grows
+// every object containing a Logger, and before C++17 new does not honour the alignment. The
+// loggerLayout benchmark shows whether it pays off for a workload.
+#if defined( EINHARD_LOGGER_ALIGNMENT ) && EINHARD_LOGGER_ALIGNMENT > 0
+#define EINHARD_LOGGER_ALIGNAS_ alignas( EINHARD_LOGGER_ALIGNMENT )
+#define EINHARD_LOGGER_SIZE_ \
+	( EINHARD_LOGGER_ALIGNMENT > 2 * sizeof( void * ) ? EINHARD_LOGGER_ALIGNMENT : 2 * sizeof( void * ) )
+#else
+#define EINHARD_LOGGER_ALIGNAS_
+#define EINHARD_LOGGER_SIZE_ ( 2 * sizeof( void * ) )
+#endif
+
 /**
  * This namespace contains all objects required for logging using Einhard.
  */
@@ -94,7 +134,11 @@ namespace einhard
 	/**
 	 * Version string of the Einhard library
 	 */
+#ifdef EINHARD_HEADER_ONLY
+	char const VERSION[] = "0.4";
+#else
 	extern char const VERSION[];
+#endif
 
 	/**
 	 * Specification of the message severity.
@@ -118,23 +162,133 @@ namespace einhard
 	 *
 	 * The overload can optimize better because it can determine the LogLevel at compile time.
 	 */
-	template <LogLevel> const char *getLogLevelString() noexcept;
+	template <LogLevel> EINHARD_INLINE_ const char *getLogLevelString() noexcept;
 	/**
 	 * Overload of the above function for situations where the LogLevel \p level is only determined at run time.
 	 */
-	const char *getLogLevelString( LogLevel level );
+	EINHARD_INLINE_ const char *getLogLevelString( LogLevel level );
+
+	/**
+	 * The name of \p level without the padding of getLogLevelString(), e.g. "INFO". An empty
+	 * string for values that are no LogLevel.
+	 */
+	EINHARD_INLINE_ const char *getLogLevelName( LogLevel level ) noexcept;
 
 	/**
 	 * Compares the string \p level against the strings for LogLevel and returns the one it matches.
 	 *
 	 * \param level A string, which is a textual representation of one of the
-	 *              LogLevel enumerators.
+	 *              LogLevel enumerators, accepted as by parseLogLevel().
 	 * \return The enumerator that matches the input string.
 	 * \throws std::invalid_argument if the string does not match any enumerator.
 	 */
-	LogLevel getLogLevel( const std::string &level );
+	EINHARD_INLINE_ LogLevel getLogLevel( const std::string &level );
 
-	template <LogLevel> const char *colorForLogLevel() noexcept;
+	/**
+	 * Parse the \p size chars at \p text as a LogLevel without throwing or allocating.
+	 *
+	 * The names of the enumerators are accepted in any case, as are the aliases "dbg", "information",
+	 * "warning", "err", "crit", "critical" and "none", and the numeric values "0" (ALL) to "7" (OFF).
+	 *
+	 * \return Whether \p text names a LogLevel. Only then \p level is assigned.
+	 */
+	EINHARD_INLINE_ bool parseLogLevel( const char *text, std::size_t size, LogLevel &level ) noexcept;
+	/**
+	 * Overload of the above function for null-terminated strings.
+	 */
+	inline bool parseLogLevel( const char *text, LogLevel &level ) noexcept
+	{
+		return parseLogLevel( text, std::strlen( text ), level );
+	}
+	inline bool parseLogLevel( const std::string &text, LogLevel &level ) noexcept
+	{
+		return parseLogLevel( text.data(), text.size(), level );
+	}
+#if __cplusplus >= 201703L
+	inline bool parseLogLevel( std::string_view text, LogLevel &level ) noexcept
+	{
+		return parseLogLevel( text.data(), text.size(), level );
+	}
+#endif
+
+	/**
+	 * Parse a list of verbosities like "WARN,app.net=debug, app.net.http = trace".
+	 *
+	 * Items are separated by commas. Each item is either an area name and a LogLevel separated by
+	 * '=' or a LogLevel alone, which applies to the root "". Spaces and tabs around names and
+	 * levels are ignored, as are empty items. The levels are parsed by parseLogLevel().
+	 *
+	 * \param onSpec Called as onSpec( const char *area, std::size_t areaSize, LogLevel level )
+	 *               for each item in order. It is not called for the items following an invalid one.
+	 * \param errorOffset If not null, receives the offset of the first invalid item.
+	 * \return Whether all items are valid.
+	 */
+	template <typename F>
+	bool parseLevelSpecs( const char *text, std::size_t size, F &&onSpec, std::size_t *errorOffset = nullptr )
+	{
+		const char *const end = text + size;
+		for( const char *item = text;; )
+		{
+			const char *itemEnd = static_cast<const char *>( std::memchr( item, ',', end - item ) );
+			if( !itemEnd )
+			{
+				itemEnd = end;
+			}
+			const char *const equals = static_cast<const char *>( std::memchr( item, '=', itemEnd - item ) );
+			const char *area = item;
+			const char *areaEnd = equals ? equals : item;
+			const char *name = equals ? equals + 1 : item;
+			const char *nameEnd = itemEnd;
+			const auto isBlank = []( char c ) { return c == ' ' || c == '\t'; };
+			while( area < areaEnd && isBlank( *area ) )
+			{
+				++area;
+			}
+			while( areaEnd > area && isBlank( areaEnd[-1] ) )
+			{
+				--areaEnd;
+			}
+			while( name < nameEnd && isBlank( *name ) )
+			{
+				++name;
+			}
+			while( nameEnd > name && isBlank( nameEnd[-1] ) )
+			{
+				--nameEnd;
+			}
+			if( equals || name != nameEnd )
+			{
+				LogLevel level;
+				if( !parseLogLevel( name, nameEnd - name, level ) )
+				{
+					if( errorOffset )
+					{
+						*errorOffset = item - text;
+					}
+					return false;
+				}
+				onSpec( area, static_cast<std::size_t>( areaEnd - area ), level );
+			}
+			if( itemEnd == end )
+			{
+				return true;
+			}
+			item = itemEnd + 1;
+		}
+	}
+#if __cplusplus >= 201703L
+	template <typename F>
+	bool parseLevelSpecs( std::string_view specs, F &&onSpec, std::size_t *errorOffset = nullptr )
+	{
+		return parseLevelSpecs( specs.data(), specs.size(), std::forward<F>( onSpec ), errorOffset );
+	}
+#else
+	template <typename F>
+	bool parseLevelSpecs( const std::string &specs, F &&onSpec, std::size_t *errorOffset = nullptr )
+	{
+		return parseLevelSpecs( specs.data(), specs.size(), std::forward<F>( onSpec ), errorOffset );
+	}
+#endif
 
 	/**
 	 * A stream modifier that allows to colorize the log output.
@@ -156,6 +310,11 @@ namespace einhard
 		{
 			return Parent::ANSI();
 		}
+		/// The number of bytes of ansiCode(), known at compile time.
+		EINHARD_ALWAYS_INLINE_ constexpr std::size_t ansiLength() const noexcept
+		{
+			return Parent::LENGTH;
+		}
 		EINHARD_ALWAYS_INLINE_ bool resetColor() const noexcept
 		{
 			return reset;
@@ -170,10 +329,11 @@ namespace einhard
 #define _COLOR( name, code )                                                                                           \
 	struct name##_t_                                                                                               \
 	{                                                                                                              \
-		static const char *ANSI() noexcept                                                                     \
+		static constexpr const char *ANSI() noexcept                                                           \
 		{                                                                                                      \
 			return "\33[" code "m";                                                                        \
 		}                                                                                                      \
+		static constexpr std::size_t LENGTH = sizeof( "\33[" code "m" ) - 1;                                  \
 	};                                                                                                             \
 	typedef Color<name##_t_> name
 
@@ -196,6 +356,299 @@ namespace einhard
 	_COLOR(NoColor, "0"    );
 #undef _COLOR
 
+	/**
+	 * The color used for the header of records of the given LogLevel.
+	 */
+	template <LogLevel> struct LevelColor
+	{
+		typedef NoColor_t_ type;
+	};
+	template <> struct LevelColor<TRACE> { typedef DBlue_t_ type; };
+	template <> struct LevelColor<DEBUG> { typedef Blue_t_ type; };
+	template <> struct LevelColor<INFO>  { typedef DGreen_t_ type; };
+	template <> struct LevelColor<WARN>  { typedef Orange_t_ type; };
+	template <> struct LevelColor<ERROR> { typedef DRed_t_ type; };
+	template <> struct LevelColor<FATAL> { typedef Red_t_ type; };
+
+	template <LogLevel LEVEL> constexpr const char *colorForLogLevel() noexcept
+	{
+		return LevelColor<LEVEL>::type::ANSI();
+	}
+
+	/**
+	 * A completely formatted log record as it is handed to a Sink.
+	 *
+	 * The data is only valid for the duration of the Sink::write() call and always ends with
+	 * a newline.
+	 */
+	struct Record
+	{
+		LogLevel level;
+		const char *data;
+		std::size_t size;
+		/// Whether data contains ANSI color codes
+		bool colored;
+		/**
+		 * The offset of the message in data, following the header "[HH:MM:SS] LEVEL area: " and
+		 * its color codes. 0 if the record has not been formatted by a Logger. In a Batch this is
+		 * the message of the first record, the following records keep their headers.
+		 */
+		std::size_t message;
+		/// The offset and length of the area name in data, areaSize is 0 without an area
+		std::size_t area;
+		std::size_t areaSize;
+		/// The number of spaces continuation lines of the message are indented by
+		std::size_t indent;
+
+		/**
+		 * Retrieve the record with all color codes removed, e.g. for output to a file.
+		 */
+		EINHARD_INLINE_ void withoutColor( std::string &plain ) const;
+	};
+
+	/**
+	 * The destination of formatted log records.
+	 *
+	 * A sink is shared by all Logger objects and thus must accept calls to write() from
+	 * multiple threads at the same time.
+	 */
+	class Sink
+	{
+	public:
+		EINHARD_INLINE_ virtual ~Sink();
+		/**
+		 * Output the given record. Implementations must not throw.
+		 */
+		virtual void write( const Record &record ) noexcept = 0;
+	};
+
+	/**
+	 * A Sink writing to a stdio stream. This is what Einhard uses by default, writing to stdout.
+	 */
+	class StdioSink : public Sink
+	{
+	public:
+		/**
+		 * \param stripColor Remove color codes from the records, e.g. because \p stream is not a
+		 *                   terminal but the Logger objects are set to colorize their output.
+		 */
+		explicit StdioSink( std::FILE *stream, bool stripColor = false ) noexcept
+		    : stream( stream ), stripColor( stripColor )
+		{
+		}
+		EINHARD_INLINE_ void write( const Record &record ) noexcept override;
+
+	private:
+		std::FILE *stream;
+		bool stripColor;
+	};
+
+	/**
+	 * Select the Sink all log records are written to.
+	 *
+	 * The caller retains ownership of \p sink and must keep it alive until another sink has
+	 * been selected and all threads are done logging to it.
+	 *
+	 * \param sink The new sink. A nullptr restores the default sink writing to stdout.
+	 * \return The previously selected sink.
+	 */
+	EINHARD_INLINE_ Sink *setSink( Sink *sink ) noexcept;
+	/**
+	 * Retrieve the Sink log records are currently written to.
+	 */
+	EINHARD_INLINE_ Sink &getSink() noexcept;
+
+	/**
+	 * An object that must be brought into a consistent state around fork(), e.g. a Sink owning
+	 * a thread, a lock or buffered records.
+	 *
+	 * Einhard calls the registered handlers from its pthread_atfork handlers, after it has taken
+	 * its own locks. prepareFork() is called in the reverse order of registration, so a Sink
+	 * registered after the Sink it writes to can still write to it. The other functions are called
+	 * in the order of registration. None of them may log.
+	 */
+	class ForkHandler
+	{
+	public:
+		EINHARD_INLINE_ virtual ~ForkHandler();
+		/// Called in the parent before fork(). Finish pending work and take the locks of the object.
+		virtual void prepareFork() noexcept = 0;
+		/// Called in the parent after fork(). Release the locks taken in prepareFork().
+		virtual void afterForkInParent() noexcept = 0;
+		/// Called in the child, which only runs the forking thread. Release the locks taken in
+		/// prepareFork(), drop work the parent will finish and restart threads.
+		virtual void afterForkInChild() noexcept = 0;
+	};
+
+	/**
+	 * Have \p handler called around fork() until it is unregistered. The caller retains ownership.
+	 */
+	EINHARD_INLINE_ void registerForkHandler( ForkHandler *handler );
+	EINHARD_INLINE_ void unregisterForkHandler( ForkHandler *handler ) noexcept;
+
+	/**
+	 * Set the verbosity of the Logger objects named \p name and of all their descendants that do
+	 * not set their own.
+	 *
+	 * Logger names form a hierarchy separated by dots: "app.net.http" is a child of "app.net",
+	 * which is a child of "app". Each name inherits its verbosity, colorization and Sink from its
+	 * parent unless they are set for the name itself. The root "" holds the defaults: WARN,
+	 * colorized output if stdout is a terminal and the Sink selected by setSink( Sink * ).
+	 *
+	 * Changes are pushed to the affected Logger objects right away, so checking whether a record
+	 * is enabled costs the same no matter how deep the Logger is in the hierarchy.
+	 */
+	EINHARD_INLINE_ void setVerbosity( const std::string &name, LogLevel verbosity );
+	/**
+	 * Select whether the Logger objects named \p name and their descendants colorize their output.
+	 */
+	EINHARD_INLINE_ void setColorize( const std::string &name, bool colorize );
+	/**
+	 * Select the Sink of the Logger objects named \p name and their descendants. A nullptr selects
+	 * the Sink of setSink( Sink * ). The caller retains ownership of \p sink.
+	 */
+	EINHARD_INLINE_ void setSink( const std::string &name, Sink *sink );
+	/**
+	 * Make \p name inherit all settings from its parent again.
+	 */
+	EINHARD_INLINE_ void resetConfiguration( const std::string &name );
+	/**
+	 * The verbosity in effect for Logger objects named \p name.
+	 */
+	EINHARD_INLINE_ LogLevel getVerbosity( const std::string &name );
+	/**
+	 * Set the verbosities of a list of names as parsed by parseLevelSpecs(), e.g. from a
+	 * configuration file. The affected Logger objects are refreshed once, no matter how many names
+	 * are listed.
+	 *
+	 * \param errorOffset If not null, receives the offset of the first invalid item.
+	 * \return Whether all items are valid. Nothing is changed otherwise.
+	 */
+	EINHARD_INLINE_ bool setVerbosities( const std::string &specs, std::size_t *errorOffset = nullptr );
+
+	/**
+	 * Enable the flight recorder.
+	 *
+	 * Records with a severity below \p level are no longer written to the Sink. Instead each thread
+	 * keeps the last \p recordsPerThread of them in a fixed-size ring buffer, without doing any I/O
+	 * or taking any locks. The buffered records are written to the Sink of their Logger, ordered by
+	 * the time they were logged, on dumpFlightRecorder() or whenever a record of severity
+	 * \p dumpLevel or higher is logged.
+	 *
+	 * Remember that records still need to pass the verbosity of their Logger to reach the flight
+	 * recorder, i.e. to record TRACE messages the Logger needs a verbosity of TRACE.
+	 *
+	 * \param level Records of a lower severity go to the flight recorder only.
+	 * \param dumpLevel Records of this or a higher severity trigger a dump. OFF disables this.
+	 * \param recordsPerThread The number of records kept per thread. Must be a power of two.
+	 * \param recordSize The maximum size of a record in bytes, longer ones are truncated. At most
+	 *                   4096.
+	 * \throws std::invalid_argument if the ring geometry is invalid.
+	 */
+	EINHARD_INLINE_ void enableFlightRecorder( LogLevel level, LogLevel dumpLevel = ERROR,
+	                                           std::size_t recordsPerThread = 256, std::size_t recordSize = 256 );
+	/**
+	 * Stop capturing records in the flight recorder. Records already captured can still be dumped.
+	 */
+	EINHARD_INLINE_ void disableFlightRecorder() noexcept;
+	/**
+	 * Write all records captured by the flight recorder since the last dump to the Sink of their
+	 * Logger.
+	 */
+	EINHARD_INLINE_ void dumpFlightRecorder() noexcept;
+	/**
+	 * Dump the flight recorder to stdout when the signal \p signum arrives.
+	 *
+	 * This bypasses the Sink, as sinks are not async-signal-safe. A previously installed handler is
+	 * invoked afterwards. Without one the default action is taken, except for SIGUSR1 and SIGUSR2,
+	 * for which the program continues after the dump.
+	 *
+	 * \return false if the handler could not be installed.
+	 */
+	EINHARD_INLINE_ bool installFlightRecorderSignalHandler( int signum ) noexcept;
+
+	/**
+	 * A binary payload to be streamed into a record, created by hex(), hexdump() or blob().
+	 *
+	 * The bytes are encoded straight into the record, no temporary string is built. Only the
+	 * first \c limit bytes are encoded, the number of omitted bytes is appended.
+	 */
+	struct Payload
+	{
+		enum Format
+		{
+			HEX,      /**< Lowercase hex digits without separators */
+			HEXDUMP,  /**< One line per 16 bytes with offset, hex digits and printable characters */
+			BLOB      /**< Printable characters as they are, all others escaped like \\n or \\x1f */
+		};
+
+		const unsigned char *data;
+		std::size_t size;
+		std::size_t limit;
+		Format format;
+	};
+
+	/**
+	 * Set the number of bytes of a Payload encoded by default. Defaults to 4096.
+	 * SIZE_MAX disables truncation.
+	 */
+	EINHARD_INLINE_ void setPayloadLimit( std::size_t bytes ) noexcept;
+	EINHARD_INLINE_ std::size_t payloadLimit() noexcept;
+
+	/**
+	 * Log \p size bytes at \p data as hex digits, e.g. "deadbeef".
+	 */
+	inline Payload hex( const void *data, std::size_t size, std::size_t limit = payloadLimit() ) noexcept
+	{
+		return {static_cast<const unsigned char *>( data ), size, limit, Payload::HEX};
+	}
+	/**
+	 * Log \p size bytes at \p data like hexdump -C does. Each line of the dump starts on a new
+	 * line of the record and is aligned with the message.
+	 */
+	inline Payload hexdump( const void *data, std::size_t size, std::size_t limit = payloadLimit() ) noexcept
+	{
+		return {static_cast<const unsigned char *>( data ), size, limit, Payload::HEXDUMP};
+	}
+	/**
+	 * Log \p size bytes at \p data as text, escaping everything but printable ASCII characters.
+	 */
+	inline Payload blob( const void *data, std::size_t size, std::size_t limit = payloadLimit() ) noexcept
+	{
+		return {static_cast<const unsigned char *>( data ), size, limit, Payload::BLOB};
+	}
+
+	EINHARD_INLINE_ std::ostream &operator<<( std::ostream &out, const Payload &payload );
+
+	/**
+	 * The memory Einhard holds for formatting records, see setRecordBufferLimits().
+	 */
+	struct RecordBufferStats
+	{
+		std::size_t buffers;        /**< Buffers in use or pooled */
+		std::size_t bytes;          /**< Memory held by all buffers */
+		std::size_t peakBytes;      /**< The highest value of bytes seen */
+		std::size_t pooledBuffers;  /**< Buffers waiting in the pool for a thread */
+		std::size_t pooledBytes;    /**< Memory held by the pooled buffers */
+		std::uint64_t allocated;    /**< Buffers created because the pool was empty */
+		std::uint64_t trimmed;      /**< Times a buffer grown beyond the trim capacity was shrunk */
+	};
+
+	/**
+	 * Bound the memory Einhard holds for formatting records.
+	 *
+	 * Each thread formats its records in a buffer borrowed from a global pool, which it returns
+	 * when it exits, so short-lived threads reuse the buffers of their predecessors, the one
+	 * returned last first. A buffer grown beyond \p trimCapacity by a large record is shrunk right
+	 * after that record, so the pooled buffers are never larger than that.
+	 *
+	 * \param trimCapacity Defaults to 64 KiB.
+	 * \param poolCapacity The memory the pooled buffers may hold, further buffers returned to the
+	 *                     pool are freed. Defaults to 1 MiB.
+	 */
+	EINHARD_INLINE_ void setRecordBufferLimits( std::size_t trimCapacity, std::size_t poolCapacity ) noexcept;
+	EINHARD_INLINE_ RecordBufferStats recordBufferStats() noexcept;
+
 	/**
 	 * A minimal class that implements the output stream operator to do nothing. This completely
 	 * eliminates the output stream statements from the resulting binary.
@@ -213,37 +666,418 @@ namespace einhard
 		}
 	};
 
-	class UnconditionalOutput
+	class TaskContext;
+
+	namespace detail
+	{
+		struct TreeNode;
+
+		/**
+		 * The settings of a Logger that are only required to format enabled records.
+		 *
+		 * A LoggerConfig is immutable once it has been published to the Logger. Changes create a
+		 * new copy which replaces the old one, so readers never see a partially updated config.
+		 */
+		struct LoggerConfig
+		{
+			bool colorize;
+			char timeSeparator;
+			char areaName[64];
+			// A sampled record of LogLevel n is kept if a 32 bit random number (or the hash of
+			// its SampleKey) is below sampleThreshold[n]. Only used for levels in sampledLevels.
+			std::uint64_t sampleThreshold[OFF];
+			// The destination of the records, nullptr selects the one of setSink( Sink * )
+			Sink *sink;
+			// The node of the logger hierarchy the Logger is attached to, if any
+			TreeNode *node;
+		};
+
+		typedef std::atomic<const LoggerConfig *> SharedConfig;
+
+		/**
+		 * The settings a node of the logger hierarchy passes on to its Logger objects.
+		 */
+		struct TreeSettings
+		{
+			LogLevel verbosity;
+			bool colorize;
+			Sink *sink;
+		};
+
+		/**
+		 * Applies the settings of its node to a Logger attached to the hierarchy.
+		 */
+		typedef void ( *TreeRefresh )( void *logger, const TreeSettings &settings );
+
+		/**
+		 * Attach \p logger to the node \p name of the hierarchy, creating it if necessary, and
+		 * apply the settings of the node.
+		 */
+		EINHARD_INLINE_ TreeNode *attachToTree( const std::string &name, void *logger, TreeRefresh refresh );
+		/**
+		 * Attach \p logger to \p node as well, e.g. for a copy of a Logger already attached to it.
+		 */
+		EINHARD_INLINE_ void attachToNode( TreeNode *node, void *logger, TreeRefresh refresh );
+		/**
+		 * Stop applying changes of the hierarchy to \p logger.
+		 */
+		EINHARD_INLINE_ void detachFromTree( TreeNode *node, void *logger ) noexcept;
+
+		/**
+		 * Decide whether to keep a record of \p level, using a thread local pseudo random number.
+		 */
+		EINHARD_INLINE_ bool keepSample( const SharedConfig &config, LogLevel level ) noexcept;
+		/**
+		 * Decide whether to keep a record of \p level, based on the hash of its SampleKey. For a
+		 * given key the decision is always the same.
+		 */
+		EINHARD_INLINE_ bool keepSample( const SharedConfig &config, LogLevel level,
+		                                 std::uint64_t keyHash ) noexcept;
+
+		/**
+		 * Marks the current thread as reading a published LoggerConfig.
+		 *
+		 * A LoggerConfig retired while any thread holds a guard that might have seen it is only
+		 * freed after all those guards have been destroyed. Guards never block and may be nested.
+		 */
+		class EpochGuard
+		{
+		public:
+			EINHARD_INLINE_ EpochGuard() noexcept;
+			EINHARD_INLINE_ ~EpochGuard();
+			EpochGuard( const EpochGuard & ) = delete;
+			EpochGuard &operator=( const EpochGuard & ) = delete;
+		};
+
+		/**
+		 * Free \p config once no EpochGuard can refer to it anymore. The config must already be
+		 * unreachable for new readers.
+		 */
+		EINHARD_INLINE_ void retireConfig( const LoggerConfig *config ) noexcept;
+
+		/**
+		 * Offer a completely formatted record to the flight recorder.
+		 *
+		 * Dumps the flight recorder if the record's severity requests it. A captured record is
+		 * dumped to \p sink, the Sink of its Logger, or the one of setSink( Sink * ) if nullptr.
+		 *
+		 * \return true if the record has been captured and must not be written to the Sink.
+		 */
+		EINHARD_INLINE_ bool captureInFlightRecorder( const Record &record, Sink *sink ) noexcept;
+		/**
+		 * Dump the records captured for \p sink, which is being destroyed, to the one of
+		 * setSink( Sink * ) instead.
+		 */
+		EINHARD_INLINE_ void forgetSinkInFlightRecorder( const Sink *sink ) noexcept;
+
+		/*
+		 * Bring the state of each part of Einhard into a consistent state around fork(). Called by
+		 * the pthread_atfork handlers, which installForkHandlers() installs once.
+		 */
+		EINHARD_INLINE_ void installForkHandlers() noexcept;
+		EINHARD_INLINE_ void lockLocalTimeForFork() noexcept;
+		EINHARD_INLINE_ void unlockLocalTimeAfterFork() noexcept;
+		EINHARD_INLINE_ void lockEpochForFork() noexcept;
+		EINHARD_INLINE_ void unlockEpochAfterFork( bool child ) noexcept;
+		EINHARD_INLINE_ void lockTreeForFork() noexcept;
+		EINHARD_INLINE_ void unlockTreeAfterFork() noexcept;
+		EINHARD_INLINE_ void resetFlightRecorderAfterFork() noexcept;
+
+		struct RecordBufferSlot;
+
+		/**
+		 * The storage a record is formatted in before it is indented and handed to the Sink.
+		 *
+		 * Unlike a std::ostringstream it exposes its capacity, can be shrunk and does not copy the
+		 * formatted record. Obtained from acquireRecordBuffer() and returned by
+		 * releaseRecordBuffer(), which resets the formatting flags of the stream.
+		 */
+		class RecordBuffer : public std::streambuf
+		{
+		public:
+			EINHARD_INLINE_ RecordBuffer();
+			EINHARD_INLINE_ ~RecordBuffer();
+			RecordBuffer( const RecordBuffer & ) = delete;
+			RecordBuffer &operator=( const RecordBuffer & ) = delete;
+
+			const char *data() const noexcept
+			{
+				return pbase();
+			}
+			std::size_t size() const noexcept
+			{
+				return pptr() - pbase();
+			}
+			/// The memory held, including the indented copy in output
+			std::size_t capacity() const noexcept
+			{
+				return ( epptr() - pbase() ) + output.capacity();
+			}
+
+			std::ostream stream;
+			// The record with continuation lines indented, as handed to the Sink
+			std::string output;
+			// The memory of this buffer included in recordBufferStats()
+			std::size_t accounted = 0;
+			// The next buffer in the list of pooled buffers
+			RecordBuffer *next = nullptr;
+			// The slot keeping this buffer, nullptr if it goes back to the pool after the record
+			RecordBufferSlot *slot = nullptr;
+
+			/// Start the next record
+			void clear() noexcept
+			{
+				setp( pbase(), epptr() );
+			}
+			/// Free the memory held, the next record allocates it again
+			EINHARD_INLINE_ void shrink() noexcept;
+
+		protected:
+			EINHARD_INLINE_ int_type overflow( int_type c ) override;
+			EINHARD_INLINE_ std::streamsize xsputn( const char *s, std::streamsize n ) override;
+
+		private:
+			EINHARD_INLINE_ void grow( std::size_t required );
+		};
+
+		/**
+		 * A buffer kept for the records of a thread or a TaskContext, so they take no lock.
+		 */
+		struct RecordBufferSlot
+		{
+			RecordBuffer *buffer = nullptr;
+			bool inUse = false;
+		};
+
+		/**
+		 * Borrow a buffer for formatting a record. Without nesting this is the buffer kept by
+		 * \p task or, without a task, by the calling thread.
+		 */
+		EINHARD_INLINE_ RecordBuffer *acquireRecordBuffer( TaskContext *task );
+		/**
+		 * Return the buffer kept by \p slot to the pool.
+		 */
+		EINHARD_INLINE_ void emptyRecordBufferSlot( RecordBufferSlot &slot ) noexcept;
+		/**
+		 * Give back a buffer obtained by acquireRecordBuffer(), trimming it if it has grown
+		 * beyond the trim capacity.
+		 */
+		EINHARD_INLINE_ void releaseRecordBuffer( RecordBuffer *buffer ) noexcept;
+		EINHARD_INLINE_ void lockRecordBuffersForFork() noexcept;
+		EINHARD_INLINE_ void unlockRecordBuffersAfterFork() noexcept;
+
+		/**
+		 * The bitmask of enabled levels for the given verbosity: bit n is set if records of
+		 * LogLevel n are output.
+		 */
+		constexpr std::uint8_t enabledLevelsMask( LogLevel verbosity ) noexcept
+		{
+			return static_cast<std::uint8_t>( ( 0xffu << verbosity ) &
+			                                  ( ( 1u << OFF ) - ( 1u << TRACE ) ) );
+		}
+	}
+
+	/**
+	 * The logging state of a logical task, e.g. a request whose coroutines or callbacks hop
+	 * between the threads of an executor.
+	 *
+	 * While a TaskContext is current on a thread, the records of that thread are tagged with its
+	 * correlation id, like "[12:00:00]  INFO net: [req-42] message", and formatted in a buffer of
+	 * the task instead of one of the thread. An executor makes the context of a task current for
+	 * each slice of the task it runs, with a Scope or enter() and leave():
+	 *
+	 * \code
+	 * executor.post( [context, work]() {
+	 *     einhard::TaskContext::Scope scope( *context );
+	 *     work();
+	 * } );
+	 * \endcode
+	 *
+	 * A coroutine holds its Scope for its whole body and wraps its co_await expressions with
+	 * await(), which leaves the context while the coroutine is suspended and enters it again on
+	 * the thread resuming it. A promise type can do the latter for all co_await expressions in
+	 * its await_transform(). A record must be complete before the coroutine suspends.
+	 *
+	 * \code
+	 * Task handle( Request request )
+	 * {
+	 *     einhard::TaskContext context( request.id() );
+	 *     einhard::TaskContext::Scope scope( context );
+	 *     logger.info() << "reading";
+	 *     auto data = co_await context.await( socket.read() );
+	 *     logger.info() << "read " << data.size() << " bytes";
+	 * }
+	 * \endcode
+	 *
+	 * A TaskContext is current on at most one thread at a time.
+	 */
+	class TaskContext
 	{
+	public:
+		/// An empty \p correlationId formats the records like those of no task.
+		EINHARD_INLINE_ explicit TaskContext( std::string correlationId = std::string() );
+		EINHARD_INLINE_ ~TaskContext();
+		TaskContext( const TaskContext & ) = delete;
+		TaskContext &operator=( const TaskContext & ) = delete;
+
+		const std::string &correlationId() const noexcept
+		{
+			return id;
+		}
+
+		/**
+		 * Make this context current on the calling thread until the matching call of leave(),
+		 * which restores the one current before. Calls may be nested, also with other contexts
+		 * in between: entering a context again makes it current again. Nesting deeper than four
+		 * levels allocates, which may throw std::bad_alloc, leaving the current context as it was.
+		 */
+		EINHARD_INLINE_ void enter();
+		EINHARD_INLINE_ void leave() noexcept;
+
+		/// The context current on the calling thread, nullptr if there is none.
+		EINHARD_INLINE_ static TaskContext *current() noexcept;
+
+		/**
+		 * Makes a TaskContext current for its lifetime.
+		 */
+		class Scope
+		{
+		public:
+			explicit Scope( TaskContext &context ) : context( context )
+			{
+				context.enter();
+			}
+			~Scope()
+			{
+				context.leave();
+			}
+			Scope( const Scope & ) = delete;
+			Scope &operator=( const Scope & ) = delete;
+
+		private:
+			TaskContext &context;
+		};
+
+#ifdef EINHARD_HAS_COROUTINES
+		template <typename Awaiter> class Awaiting;
+
+		/**
+		 * Wrap the awaiter of a co_await expression, e.g. std::suspend_always or what an executor's
+		 * schedule() returns, so this context is left while the coroutine is suspended and entered
+		 * again when it resumes, on whichever thread that is.
+		 */
+		template <typename Awaiter> Awaiting<Awaiter> await( Awaiter &&awaiter )
+		{
+			return Awaiting<Awaiter>( *this, std::forward<Awaiter>( awaiter ) );
+		}
+#endif
+
 	private:
-		// Pointer to the thread_local stringstream (if enabled)
-		std::ostringstream *out;
-#ifdef EINHARD_NO_THREAD_LOCAL
-		// without thread_local we simply use a local stringstream object
-		std::ostringstream realOut;
+		friend detail::RecordBuffer *detail::acquireRecordBuffer( TaskContext *task );
+
+		/*
+		 * Restores the context current before the outermost enter() of this one, returns whether
+		 * it has been entered. attach() makes it current again, the calling thread's current
+		 * context is then restored by the outermost leave().
+		 */
+		EINHARD_INLINE_ bool detach() noexcept;
+		EINHARD_INLINE_ void attach() noexcept;
+
+		std::string id;
+		// The context current before each enter() not left yet, the innermost one last
+		std::vector<TaskContext *> previous;
+		detail::RecordBufferSlot buffer;
+	};
+
+#ifdef EINHARD_HAS_COROUTINES
+	template <typename Awaiter> class TaskContext::Awaiting
+	{
+	public:
+		Awaiting( TaskContext &context, Awaiter &&awaiter )
+		    : context( context ), awaiter( std::forward<Awaiter>( awaiter ) )
+		{
+		}
+
+		bool await_ready()
+		{
+			return awaiter.await_ready();
+		}
+
+		template <typename Promise> decltype( auto ) await_suspend( std::coroutine_handle<Promise> handle )
+		{
+			// Another thread may resume the coroutine before await_suspend() of the awaiter returns
+			detached = context.detach();
+			try
+			{
+				return awaiter.await_suspend( handle );
+			}
+			catch( ... )
+			{
+				// the coroutine continues on this thread
+				if( detached )
+				{
+					context.attach();
+					detached = false;
+				}
+				throw;
+			}
+		}
+
+		decltype( auto ) await_resume()
+		{
+			if( detached )
+			{
+				context.attach();
+				detached = false;
+			}
+			return awaiter.await_resume();
+		}
+
+	private:
+		TaskContext &context;
+		Awaiter awaiter;
+		bool detached = false;
+	};
 #endif
+
+	class UnconditionalOutput
+	{
+	private:
+		// The pooled buffer the record is formatted in and its stream
+		detail::RecordBuffer *buffer;
+		std::ostream *out;
 		// The number of chars required for aligning
 		unsigned char indent;
+		// The area name and the message in the buffer, see Record
+		std::size_t area = 0;
+		std::size_t areaSize = 0;
+		std::size_t message = 0;
+		// The severity of the record, required by the Sink
+		LogLevel level;
+		// The Sink of the Logger, nullptr for the one of setSink( Sink * )
+		Sink *sink;
 		// Whether to colorize the output
-		const bool colorize;
+		bool colorize;
 		// Whether the color needs to be reset with the next operator<<
 		bool resetColor = false;
+		// Whether a color other than the default is in effect and must be reset at the end of the record
+		bool colorActive = false;
 
 	public:
 		template <LogLevel VERBOSITY>
-		EINHARD_ALWAYS_INLINE_ UnconditionalOutput( const bool colorize_, const char *areaName, const char timeSeparator,
+		EINHARD_ALWAYS_INLINE_ UnconditionalOutput( const detail::SharedConfig &config,
 							    std::integral_constant<LogLevel, VERBOSITY> )
-		    : colorize( colorize_ )
 		{
-			doInit<VERBOSITY>( areaName, timeSeparator );
+			doInit<VERBOSITY>( config );
 		}
 
 		template <typename T> UnconditionalOutput &operator<<( const Color<T> &col )
 		{
 			if( colorize )
 			{
-				*out << col.ansiCode();
+				out->write( col.ansiCode(), col.ansiLength() );
 				resetColor = col.resetColor();
+				colorActive = !std::is_same<T, NoColor_t_>::value;
 			}
 			return *this;
 		}
@@ -257,18 +1091,21 @@ namespace einhard
 		template <typename T> EINHARD_ALWAYS_INLINE_ UnconditionalOutput &operator<<( const T &msg )
 		{
 			*out << msg;
-			checkColorReset();
+			if( resetColor )
+			{
+				doColorReset();
+			}
 			return *this;
 		}
 
-		void doCleanup() noexcept;
+		EINHARD_INLINE_ void doCleanup() noexcept;
 
 	protected:
-		EINHARD_ALWAYS_INLINE_ UnconditionalOutput( const bool colorize_ ) : colorize( colorize_ )
+		EINHARD_ALWAYS_INLINE_ UnconditionalOutput() : sink( nullptr ), colorize( false )
 		{
 		}
-		template <LogLevel VERBOSITY> void doInit( const char *areaName, const char timeSeparator );
-		void checkColorReset();
+		template <LogLevel VERBOSITY> EINHARD_INLINE_ void doInit( const detail::SharedConfig &config );
+		EINHARD_INLINE_ void doColorReset();
 	};
 	/**
 	 * A wrapper for the output stream taking care proper formatting and colorization of the output.
@@ -284,14 +1121,13 @@ namespace einhard
 			OutputFormatter( OutputFormatter && ) = default;
 
 			template <LogLevel VERBOSITY>
-			EINHARD_ALWAYS_INLINE_ OutputFormatter( bool enabled_, bool const colorize_,
-								const char *areaName, const char timeSeparator,
+			EINHARD_ALWAYS_INLINE_ OutputFormatter( bool enabled_, const detail::SharedConfig &config,
 								std::integral_constant<LogLevel, VERBOSITY> )
-			    : UnconditionalOutput( colorize_ ), enabled( enabled_ )
+			    : enabled( enabled_ )
 			{
 				if( enabled )
 				{
-					doInit<VERBOSITY>( areaName, timeSeparator );
+					doInit<VERBOSITY>( config );
 				}
 			}
 
@@ -332,6 +1168,181 @@ namespace einhard
 			}
 	};
 
+	/**
+	 * Collects records of one LogLevel and hands them to the Sink as a single Record, so no record
+	 * of another thread ends up between them. Created by Logger::batch().
+	 *
+	 * The header of the records is formatted once per second instead of once per record. The
+	 * collected records are submitted by submit() or when the batch is destroyed.
+	 *
+	 * \code
+	 * auto results = logger.batch( INFO );
+	 * for( const Item &item : items )
+	 * {
+	 *     results.record() << item.name << ": " << item.result;
+	 * }
+	 * \endcode
+	 *
+	 * Whether the records are output is decided once, when the batch is created: a batch of a
+	 * sampled LogLevel is kept or dropped as a whole. Sinks limiting the size of a Record, such as
+	 * ShmRingSink, truncate the batch.
+	 */
+	class Batch
+	{
+	public:
+		/**
+		 * The stream of a single record of the batch. The record is complete once this object is
+		 * destroyed, i.e. at the end of the statement, and must be before the next one is started.
+		 */
+		class Entry
+		{
+		public:
+			EINHARD_ALWAYS_INLINE_ explicit Entry( Batch *batch ) noexcept : batch( batch )
+			{
+			}
+			Entry( const Entry & ) = delete;
+			EINHARD_ALWAYS_INLINE_ Entry( Entry &&rhs ) noexcept : batch( rhs.batch )
+			{
+				rhs.batch = nullptr;
+			}
+			EINHARD_ALWAYS_INLINE_ ~Entry()
+			{
+				if( batch )
+				{
+					batch->finishRecord();
+				}
+			}
+
+			template <typename T> Entry &operator<<( const Color<T> &col )
+			{
+				if( batch && batch->colorize )
+				{
+					batch->recordBuffer->stream.write( col.ansiCode(), col.ansiLength() );
+					batch->resetColor = col.resetColor();
+					batch->colorActive = !std::is_same<T, NoColor_t_>::value;
+				}
+				return *this;
+			}
+			EINHARD_ALWAYS_INLINE_ Entry &operator<<( std::ostream &( *manip )( std::ostream & ) )
+			{
+				if( batch )
+				{
+					batch->recordBuffer->stream << manip;
+				}
+				return *this;
+			}
+			template <typename T> EINHARD_ALWAYS_INLINE_ Entry &operator<<( const T &msg )
+			{
+				if( batch )
+				{
+					batch->recordBuffer->stream << msg;
+					if( batch->resetColor )
+					{
+						batch->doColorReset();
+					}
+				}
+				return *this;
+			}
+
+		private:
+			// nullptr if the batch is not output
+			Batch *batch;
+		};
+
+		/**
+		 * \param enabled Whether the records are output at all.
+		 * \param config The config of the Logger, only used in this constructor.
+		 */
+		EINHARD_INLINE_ Batch( LogLevel level, bool enabled, const detail::SharedConfig &config );
+		Batch( const Batch & ) = delete;
+		EINHARD_INLINE_ Batch( Batch &&rhs );
+		/// Submits the records not submitted yet.
+		EINHARD_INLINE_ ~Batch();
+
+		/// Start a record.
+		EINHARD_ALWAYS_INLINE_ Entry record()
+		{
+			if( !enabled )
+			{
+				return Entry( nullptr );
+			}
+			startRecord();
+			return Entry( this );
+		}
+		/// Add a record consisting of \p args.
+		template <typename... Ts> void record( Ts &&... args )
+		{
+			Entry entry = record();
+			auto &&unused = {&( entry << args )...};
+			static_cast<void>( unused );
+		}
+
+		/**
+		 * Hand all records collected so far to the Sink as one Record. Afterwards the batch
+		 * collects the following records.
+		 */
+		EINHARD_INLINE_ void submit() noexcept;
+
+		/// The number of records collected but not submitted yet.
+		std::size_t size() const noexcept
+		{
+			return count;
+		}
+
+	private:
+		EINHARD_INLINE_ void startRecord();
+		EINHARD_INLINE_ void finishRecord() noexcept;
+		EINHARD_INLINE_ void doColorReset();
+
+		LogLevel level;
+		bool enabled;
+		bool colorize;
+		char timeSeparator;
+		Sink *sink;
+		// " LEVEL area: ", following the time in the header of each record
+		std::string headerTail;
+		unsigned char indent;
+		// The area name and the message of the first record in buffer, see Record
+		std::size_t area = 0;
+		std::size_t areaSize = 0;
+		std::size_t message = 0;
+
+		// The header of the records and the second it has been formatted for
+		std::string header;
+		std::time_t headerTime = -1;
+		// The buffer of the record being formatted, nullptr between records
+		detail::RecordBuffer *recordBuffer = nullptr;
+		bool resetColor = false;
+		bool colorActive = false;
+		// The records collected so far
+		std::string buffer;
+		std::size_t count = 0;
+	};
+
+	/**
+	 * Identifies records that belong together, e.g. by a request id, so that a sampled Logger
+	 * either keeps or drops all of them.
+	 */
+	struct SampleKey
+	{
+		std::uint64_t hash;
+
+		explicit SampleKey( std::uint64_t id ) noexcept : hash( id )
+		{
+		}
+		/// Uses the FNV-1a hash of \p id.
+		explicit SampleKey( const char *id ) noexcept : hash( 14695981039346656037ull )
+		{
+			for( ; *id; ++id )
+			{
+				hash = ( hash ^ static_cast<unsigned char>( *id ) ) * 1099511628211ull;
+			}
+		}
+		explicit SampleKey( const std::string &id ) noexcept : SampleKey( id.c_str() )
+		{
+		}
+	};
+
 	/**
      * A Logger object can be used to output messages to stdout.
      *
@@ -341,13 +1352,88 @@ namespace einhard
      *
      * The class can automatically detect non-tty output and will not colorize output in that case.
      */ 
-	template<LogLevel MAX = ALL> class Logger
+	template<LogLevel MAX = ALL> class EINHARD_LOGGER_ALIGNAS_ Logger
 	{
 		private:
-			char areaName[32 - sizeof( LogLevel ) - sizeof( bool )] = {'\0'};
-			LogLevel verbosity;
-			bool colorize;
-			char timeSeparator = ':';
+			// The only member used by isEnabled(), thus the only one read when a record is
+			// disabled. Bit n is set if records of LogLevel n are output.
+			std::atomic<std::uint8_t> enabledLevels;
+			std::atomic<std::uint8_t> verbosity;
+			// Bit n is set if records of LogLevel n are sampled, see setSampling().
+			std::atomic<std::uint8_t> sampledLevels;
+			// Everything else is only required for enabled records and lives out of line. It is
+			// replaced as a whole on changes, see detail::LoggerConfig.
+			detail::SharedConfig config;
+
+			/**
+			 * Apply \p modify to a copy of the current config and publish the copy.
+			 *
+			 * Concurrent updates are retried, so none of them gets lost.
+			 */
+			template <typename F> void updateConfig( F modify )
+			{
+				detail::EpochGuard guard;
+				const detail::LoggerConfig *current = config.load();
+				detail::LoggerConfig *updated = new detail::LoggerConfig( *current );
+				modify( *updated );
+				while( !config.compare_exchange_weak( current, updated ) )
+				{
+					*updated = *current;
+					modify( *updated );
+				}
+				detail::retireConfig( current );
+			}
+
+			/**
+			 * Whether a record of LEVEL passes the verbosity and the sampling. Sampling is only
+			 * considered for enabled records, so the disabled path stays a single load.
+			 */
+			template <LogLevel LEVEL> bool isKept() const noexcept
+			{
+				return isEnabled<LEVEL>() &&
+				       ( !( sampledLevels.load( std::memory_order_relaxed ) & ( 1u << LEVEL ) ) ||
+				         detail::keepSample( config, LEVEL ) );
+			}
+			bool isKept( LogLevel level ) const noexcept
+			{
+#ifdef NDEBUG
+				if( level == DEBUG || level == TRACE )
+				{
+					return false;
+				}
+#endif
+				return MAX <= level && level < OFF &&
+				       ( enabledLevels.load( std::memory_order_relaxed ) & ( 1u << level ) ) &&
+				       ( !( sampledLevels.load( std::memory_order_relaxed ) & ( 1u << level ) ) ||
+				         detail::keepSample( config, level ) );
+			}
+			template <LogLevel LEVEL> bool isKept( const SampleKey &key ) const noexcept
+			{
+				return isEnabled<LEVEL>() &&
+				       ( !( sampledLevels.load( std::memory_order_relaxed ) & ( 1u << LEVEL ) ) ||
+				         detail::keepSample( config, LEVEL, key.hash ) );
+			}
+
+			/**
+			 * The node of the logger hierarchy this Logger is attached to, if any.
+			 */
+			detail::TreeNode *treeNode() const noexcept
+			{
+				detail::EpochGuard guard;
+				return config.load()->node;
+			}
+			/**
+			 * Applies changes of the logger hierarchy, see detail::TreeRefresh.
+			 */
+			static void refreshFromTree( void *logger, const detail::TreeSettings &settings )
+			{
+				Logger &self = *static_cast<Logger *>( logger );
+				self.updateConfig( [&settings]( detail::LoggerConfig &c ) {
+					c.colorize = settings.colorize;
+					c.sink = settings.sink;
+				} );
+				self.setVerbosity( settings.verbosity );
+			}
 
 		public:
 			/**
@@ -356,11 +1442,11 @@ namespace einhard
 			 * The object will automatically colorize output on ttys and not colorize output
 			 * on non ttys.
 			 */
-			Logger( const LogLevel verbosity = WARN ) : verbosity( verbosity )
+			Logger( const LogLevel verbosity = WARN )
+			    // use some, sadly not c++-ways to figure out whether we are writing ot a terminal
+			    // only colorize when we are writing ot a terminal
+			    : Logger( verbosity, isatty( fileno( stdout ) ) )
 			{
-				// use some, sadly not c++-ways to figure out whether we are writing ot a terminal
-				// only colorize when we are writing ot a terminal
-				colorize = isatty( fileno( stdout ) );
 			};
 			/**
 			 * Create a new Logger object explicitly selecting whether to colorize the output or not.
@@ -369,22 +1455,93 @@ namespace einhard
 			 * output is to a non tty.
 			 */
 			Logger( const LogLevel verbosity, const bool colorize )
-			    : verbosity( verbosity ), colorize( colorize ) {};
+			    : enabledLevels( detail::enabledLevelsMask( verbosity ) ), verbosity( verbosity ),
+			      sampledLevels( 0 ),
+			      config( new detail::LoggerConfig{colorize, ':', {'\0'}, {0}, nullptr, nullptr} )
+			{
+				static_assert( offsetof( Logger, enabledLevels ) == 0,
+				               "isEnabled() must only need to read the first byte of a Logger" );
+			};
+			/**
+			 * Create a Logger that is part of the logger hierarchy, see
+			 * setVerbosity( const std::string &, LogLevel ).
+			 *
+			 * The Logger takes its verbosity, colorization and Sink from the hierarchy and uses
+			 * \p name as its area name. Calling the setters of the Logger itself only affects
+			 * this object, until the settings of \p name or one of its ancestors change.
+			 */
+			explicit Logger( const std::string &name ) : Logger( WARN, false )
+			{
+				setAreaName( name );
+				detail::TreeNode *node = detail::attachToTree( name, this, &refreshFromTree );
+				updateConfig( [node]( detail::LoggerConfig &c ) { c.node = node; } );
+			}
+
+			Logger( const Logger &rhs )
+			    : enabledLevels( rhs.enabledLevels.load( std::memory_order_relaxed ) ),
+			      verbosity( rhs.verbosity.load( std::memory_order_relaxed ) ),
+			      sampledLevels( rhs.sampledLevels.load( std::memory_order_relaxed ) ), config( nullptr )
+			{
+				{
+					detail::EpochGuard guard;
+					config.store( new detail::LoggerConfig( *rhs.config.load() ) );
+				}
+				if( detail::TreeNode *node = treeNode() )
+				{
+					detail::attachToNode( node, this, &refreshFromTree );
+				}
+			}
+			Logger &operator=( const Logger &rhs )
+			{
+				if( this != &rhs )
+				{
+					if( detail::TreeNode *node = treeNode() )
+					{
+						detail::detachFromTree( node, this );
+					}
+					detail::EpochGuard guard;
+					const detail::LoggerConfig *copy = new detail::LoggerConfig( *rhs.config.load() );
+					detail::retireConfig( config.exchange( copy ) );
+					verbosity.store( rhs.verbosity.load( std::memory_order_relaxed ),
+					                 std::memory_order_relaxed );
+					sampledLevels.store( rhs.sampledLevels.load( std::memory_order_relaxed ),
+					                     std::memory_order_relaxed );
+					enabledLevels.store( rhs.enabledLevels.load( std::memory_order_relaxed ),
+					                     std::memory_order_relaxed );
+					if( copy->node )
+					{
+						detail::attachToNode( copy->node, this, &refreshFromTree );
+					}
+				}
+				return *this;
+			}
+			~Logger()
+			{
+				if( detail::TreeNode *node = treeNode() )
+				{
+					detail::detachFromTree( node, this );
+				}
+				detail::retireConfig( config.load( std::memory_order_relaxed ) );
+			}
 
 			/**
 			 * Set an area name. This will be printed after the LogLevel to identify the
 			 * place in the code where the output is coming from. This can be used to
 			 * identify the different Logger objects in the log output.
 			 *
-			 * \param name A string. Only the first 30, or so, characters will be used. The rest
+			 * Like all setters this may be called while other threads use the Logger.
+			 *
+			 * \param name A string. Only the first 63 bytes will be used. The rest
 			 *             will not be displayed. You can reset the name with an empty string.
 			 * \warning Passing a nullptr is not allowed!
 			 */
 			void setAreaName( const char *name )
 			{
 				assert( name );
-				std::strncpy( &areaName[0], name, sizeof( areaName ) - 1 );
-				areaName[sizeof( areaName ) - 1] = '\0';
+				updateConfig( [name]( detail::LoggerConfig &c ) {
+					std::strncpy( &c.areaName[0], name, sizeof( c.areaName ) - 1 );
+					c.areaName[sizeof( c.areaName ) - 1] = '\0';
+				} );
 			}
 			EINHARD_ALWAYS_INLINE_
 			void setAreaName( const std::string &name )
@@ -399,7 +1556,7 @@ namespace einhard
 			 */
 			void setTimeSeparator(const char separator)
 			{
-				timeSeparator = separator;
+				updateConfig( [separator]( detail::LoggerConfig &c ) { c.timeSeparator = separator; } );
 			}
 
 			/** Access to the trace message stream. */
@@ -415,17 +1572,18 @@ namespace einhard
 #else
 			OutputFormatter trace() const
 			{
-				return {isEnabled<TRACE>(), colorize, areaName, timeSeparator,
+				return {isKept<TRACE>(), config,
 					std::integral_constant<LogLevel, TRACE>()};
 			}
 
 			template <typename... Ts> void trace( Ts &&... args ) const noexcept
 			{
-				if( isEnabled<TRACE>() )
+				if( isKept<TRACE>() )
 				{
-					UnconditionalOutput o{colorize, areaName, timeSeparator,
+					UnconditionalOutput o{config,
 							      std::integral_constant<LogLevel, TRACE>()};
 					auto &&unused = {&( o << args )...};
+					static_cast<void>( unused );
 					o.doCleanup();
 				}
 			}
@@ -442,16 +1600,17 @@ namespace einhard
 #else
 			OutputFormatter debug() const
 			{
-				return {isEnabled<DEBUG>(), colorize, areaName, timeSeparator,
+				return {isKept<DEBUG>(), config,
 					std::integral_constant<LogLevel, DEBUG>()};
 			}
 			template <typename... Ts> void debug( Ts &&... args ) const noexcept
 			{
-				if( isEnabled<DEBUG>() )
+				if( isKept<DEBUG>() )
 				{
-					UnconditionalOutput o{colorize, areaName, timeSeparator,
+					UnconditionalOutput o{config,
 							  std::integral_constant<LogLevel, DEBUG>()};
 					auto &&unused = {&( o << args )...};
+					static_cast<void>( unused );
 					o.doCleanup();
 				}
 			}
@@ -459,68 +1618,106 @@ namespace einhard
 			/** Access to the info message stream. */
 			OutputFormatter info() const
 			{
-				return {isEnabled<INFO>(), colorize, areaName, timeSeparator,
+				return {isKept<INFO>(), config,
 					std::integral_constant<LogLevel, INFO>()};
 			}
 			template <typename... Ts> void info( Ts &&... args ) const noexcept
 			{
-				if( isEnabled<INFO>() )
+				if( isKept<INFO>() )
 				{
-					UnconditionalOutput o{colorize, areaName, timeSeparator,
+					UnconditionalOutput o{config,
 							  std::integral_constant<LogLevel, INFO>()};
 					auto &&unused = {&( o << args )...};
+					static_cast<void>( unused );
 					o.doCleanup();
 				}
 			}
 			/** Access to the warning message stream. */
 			OutputFormatter warn() const
 			{
-				return {isEnabled<WARN>(), colorize, areaName, timeSeparator,
+				return {isKept<WARN>(), config,
 					std::integral_constant<LogLevel, WARN>()};
 			}
 			template <typename... Ts> void warn( Ts &&... args ) const noexcept
 			{
-				if( isEnabled<WARN>() )
+				if( isKept<WARN>() )
 				{
-					UnconditionalOutput o{colorize, areaName, timeSeparator,
+					UnconditionalOutput o{config,
 							  std::integral_constant<LogLevel, WARN>()};
 					auto &&unused = {&( o << args )...};
+					static_cast<void>( unused );
 					o.doCleanup();
 				}
 			}
 			/** Access to the error message stream. */
 			OutputFormatter error() const
 			{
-				return {isEnabled<ERROR>(), colorize, areaName, timeSeparator,
+				return {isKept<ERROR>(), config,
 					std::integral_constant<LogLevel, ERROR>()};
 			}
 			template <typename... Ts> void error( Ts &&... args ) const noexcept
 			{
-				if( isEnabled<ERROR>() )
+				if( isKept<ERROR>() )
 				{
-					UnconditionalOutput o{colorize, areaName, timeSeparator,
+					UnconditionalOutput o{config,
 							  std::integral_constant<LogLevel, ERROR>()};
 					auto &&unused = {&( o << args )...};
+					static_cast<void>( unused );
 					o.doCleanup();
 				}
 			}
 			/** Access to the fatal message stream. */
 			OutputFormatter fatal() const
 			{
-				return {isEnabled<FATAL>(), colorize, areaName, timeSeparator,
+				return {isKept<FATAL>(), config,
 					std::integral_constant<LogLevel, FATAL>()};
 			}
 			template <typename... Ts> void fatal( Ts &&... args ) const noexcept
 			{
-				if( isEnabled<FATAL>() )
+				if( isKept<FATAL>() )
 				{
-					UnconditionalOutput o{colorize, areaName, timeSeparator,
+					UnconditionalOutput o{config,
 							  std::integral_constant<LogLevel, FATAL>()};
 					auto &&unused = {&( o << args )...};
+					static_cast<void>( unused );
 					o.doCleanup();
 				}
 			}
 
+			/**
+			 * Access to the message stream of \p LEVEL.
+			 *
+			 * This is the same as calling the method named after the level, except that debug()
+			 * and trace() are not compiled out completely if NDEBUG is defined.
+			 */
+			template <LogLevel LEVEL> OutputFormatter log() const
+			{
+				return {isKept<LEVEL>(), config, std::integral_constant<LogLevel, LEVEL>()};
+			}
+			/**
+			 * Access to the message stream of \p LEVEL for a record identified by \p key.
+			 *
+			 * If records of \p LEVEL are sampled, either all records with the same key are kept or
+			 * none of them.
+			 */
+			template <LogLevel LEVEL> OutputFormatter log( const SampleKey &key ) const
+			{
+				return {isKept<LEVEL>( key ), config, std::integral_constant<LogLevel, LEVEL>()};
+			}
+
+			/**
+			 * Collect many records of \p level, which are output together, see Batch.
+			 *
+			 * The whole batch reaches the Sink as a single Record. Sinks handling one record at a
+			 * time see it as one multi-line record: the flight recorder truncates it to its record
+			 * size, ShmRingSink to its slot size, and SyslogSink sends it as one message with the
+			 * headers of the following records inside. Log the records individually for those.
+			 */
+			Batch batch( LogLevel level ) const
+			{
+				return {level, isKept( level ), config};
+			}
+
 			template <LogLevel LEVEL> bool isEnabled() const noexcept
 			{
 #ifdef NDEBUG
@@ -528,7 +1725,8 @@ namespace einhard
 					return false;
 				}
 #endif
-				return ( MAX <= LEVEL && verbosity <= LEVEL );
+				return ( MAX <= LEVEL &&
+				         ( enabledLevels.load( std::memory_order_relaxed ) & ( 1u << LEVEL ) ) );
 			}
 
 			/** Modify the verbosity of the Logger.
@@ -538,7 +1736,8 @@ namespace einhard
 			 */
 			inline void setVerbosity( LogLevel verbosity ) noexcept
 			{
-				this->verbosity = verbosity;
+				this->verbosity.store( verbosity, std::memory_order_relaxed );
+				enabledLevels.store( detail::enabledLevelsMask( verbosity ), std::memory_order_relaxed );
 			}
 			/** Retrieve the current log level.
 			 *
@@ -548,21 +1747,64 @@ namespace einhard
 			 */
 			inline LogLevel getVerbosity() const noexcept
 			{
-				return this->verbosity;
+				return static_cast<LogLevel>( verbosity.load( std::memory_order_relaxed ) );
 			}
 			/**
 			 * Retrieve a human readable representation of the current log level
 			 */
 			inline char const * getVerbosityString( ) const
 			{
-				return getLogLevelString(verbosity);
+				return getLogLevelString(getVerbosity());
 			}
+			/**
+			 * Only keep a fraction of the records of \p level.
+			 *
+			 * The decision is taken before the record is formatted, so dropped records cost
+			 * little more than disabled ones. Records logged with a SampleKey are kept or dropped
+			 * depending on the key, all others randomly.
+			 *
+			 * \param level The LogLevel to sample.
+			 * \param rate The fraction of records to keep, between 0 and 1. 1 disables sampling.
+			 */
+			void setSampling( LogLevel level, double rate )
+			{
+				if( level <= ALL || level >= OFF )
+				{
+					return;
+				}
+				const double clamped = rate < 0 ? 0 : rate > 1 ? 1 : rate;
+				const std::uint64_t threshold = static_cast<std::uint64_t>( clamped * 4294967296.0 );
+				updateConfig( [level, threshold]( detail::LoggerConfig &c ) {
+					c.sampleThreshold[level] = threshold;
+				} );
+				if( clamped < 1 )
+				{
+					sampledLevels.fetch_or( 1u << level, std::memory_order_relaxed );
+				}
+				else
+				{
+					sampledLevels.fetch_and( ~( 1u << level ), std::memory_order_relaxed );
+				}
+			}
+			/**
+			 * The fraction of records of \p level that are kept.
+			 */
+			double getSampling( LogLevel level ) const
+			{
+				if( !( sampledLevels.load( std::memory_order_relaxed ) & ( 1u << level ) ) )
+				{
+					return 1;
+				}
+				detail::EpochGuard guard;
+				return config.load()->sampleThreshold[level] / 4294967296.0;
+			}
+
 			/**
 			 * Select whether the output stream should be colorized.
 			 */
-			void setColorize( bool colorize ) noexcept
+			void setColorize( bool colorize )
 			{
-				this->colorize = colorize;
+				updateConfig( [colorize]( detail::LoggerConfig &c ) { c.colorize = colorize; } );
 			}
 			/**
 			 * Check whether the output stream is colorized.
@@ -571,9 +1813,25 @@ namespace einhard
             //		2020-06-23 14:28 +0800 : fix errors found by GCC 6 or 7
             bool getColorize() const noexcept
 			{
-				return this->colorize;
+				detail::EpochGuard guard;
+				return config.load()->colorize;
 			}
 	};
+
+	static_assert( sizeof( Logger<> ) == EINHARD_LOGGER_SIZE_,
+	               "a Logger must consist of the enabled levels, the verbosity and the config pointer only" );
 }
 
+#ifdef EINHARD_HEADER_ONLY
+#include "impl/buffers.hpp"
+#include "impl/einhard.hpp"
+#include "impl/epoch.hpp"
+#include "impl/flightrecorder.hpp"
+#include "impl/fork.hpp"
+#include "impl/levels.hpp"
+#include "impl/payload.hpp"
+#include "impl/task.hpp"
+#include "impl/tree.hpp"
+#endif
+
 // vim: ts=4 sw=4 tw=100 noet
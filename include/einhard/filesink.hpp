@@ -0,0 +1,80 @@
+/**
+ * @file
+ *
+ * A Sink appending log records to a file.
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "einhard.hpp"
+
+#include <string>
+
+#include <sys/types.h>
+
+namespace einhard
+{
+	/**
+	 * A Sink appending records to a file.
+	 *
+	 * Each record is written with a single write() to a descriptor opened with O_APPEND, so the
+	 * records of concurrent threads and processes sharing the file do not interleave. The
+	 * descriptor is opened with O_CLOEXEC and thus does not leak into programs started by exec().
+	 *
+	 * Every "%p" in the path is replaced by the process id. A child created by fork() then reopens
+	 * the file under its own process id. Without "%p" parent and child append to the same file.
+	 */
+	class FileSink : public Sink, private ForkHandler
+	{
+	public:
+		/**
+		 * \param pathPattern The file to append to, created if it does not exist.
+		 * \param stripColor Remove color codes from the records.
+		 * \param mode The permissions of a newly created file.
+		 * \throws std::system_error if the file cannot be opened.
+		 */
+		explicit FileSink( const std::string &pathPattern, bool stripColor = true, mode_t mode = 0644 );
+		FileSink( const FileSink & ) = delete;
+		FileSink &operator=( const FileSink & ) = delete;
+		~FileSink();
+
+		void write( const Record &record ) noexcept override;
+
+		/// The file currently written to, i.e. the pattern with the process id filled in.
+		const std::string &path() const noexcept
+		{
+			return path_;
+		}
+
+	private:
+		static std::string expand( const std::string &pattern );
+		int open( const std::string &path ) const noexcept;
+
+		void prepareFork() noexcept override;
+		void afterForkInParent() noexcept override;
+		void afterForkInChild() noexcept override;
+
+		const std::string pattern;
+		const bool stripColor;
+		const mode_t mode;
+		std::string path_;
+		int fd;
+	};
+}
+
+// vim: ts=4 sw=4 tw=100 noet
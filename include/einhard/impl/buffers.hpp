@@ -0,0 +1,322 @@
+/**
+ * @file
+ *
+ * Implementation of the pool of buffers records are formatted in.
+ *
+ * Compiled into the Einhard library, or into every translation unit including einhard.hpp if
+ * EINHARD_HEADER_ONLY is defined.
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../einhard.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+namespace einhard
+{
+	namespace detail
+	{
+		// The capacity of a buffer when it formats its first record
+		constexpr std::size_t RECORD_BUFFER_INITIAL_CAPACITY = 256;
+
+		struct RecordBufferPool
+		{
+			std::mutex mutex;
+			// A plain free list, the buffer returned last is handed out first. Their capacities need
+			// no sorting, buffers are trimmed before being returned, the byte cap bounds the rest.
+			RecordBuffer *pooled = nullptr;
+			std::size_t pooledBuffers = 0;
+			std::size_t pooledBytes = 0;
+
+			std::atomic<std::size_t> trimCapacity{64 * 1024};
+			std::atomic<std::size_t> poolCapacity{1024 * 1024};
+
+			std::atomic<std::size_t> buffers{0};
+			std::atomic<std::size_t> bytes{0};
+			std::atomic<std::size_t> peakBytes{0};
+			std::atomic<std::uint64_t> allocated{0};
+			std::atomic<std::uint64_t> trimmed{0};
+		};
+
+		// Intentionally leaked, threads return their buffers during exit.
+		EINHARD_INLINE_ RecordBufferPool &recordBufferPool()
+		{
+			static RecordBufferPool *pool = ( installForkHandlers(), new RecordBufferPool );
+			return *pool;
+		}
+
+		// Brings the memory of buffer included in the statistics up to date
+		EINHARD_INLINE_ void accountRecordBuffer( RecordBuffer &buffer ) noexcept
+		{
+			const std::size_t capacity = buffer.capacity();
+			if( capacity == buffer.accounted )
+			{
+				return;
+			}
+			RecordBufferPool &pool = recordBufferPool();
+			// unsigned arithmetic, also correct if the buffer has shrunk
+			const std::size_t delta = capacity - buffer.accounted;
+			const std::size_t bytes = pool.bytes.fetch_add( delta, std::memory_order_relaxed ) + delta;
+			buffer.accounted = capacity;
+			std::size_t peak = pool.peakBytes.load( std::memory_order_relaxed );
+			while( bytes > peak && !pool.peakBytes.compare_exchange_weak( peak, bytes, std::memory_order_relaxed ) )
+			{
+			}
+		}
+
+		EINHARD_INLINE_ RecordBuffer::RecordBuffer() : stream( this )
+		{
+			recordBufferPool().buffers.fetch_add( 1, std::memory_order_relaxed );
+		}
+
+		EINHARD_INLINE_ RecordBuffer::~RecordBuffer()
+		{
+			delete[] pbase();
+			RecordBufferPool &pool = recordBufferPool();
+			pool.bytes.fetch_sub( accounted, std::memory_order_relaxed );
+			pool.buffers.fetch_sub( 1, std::memory_order_relaxed );
+		}
+
+		EINHARD_INLINE_ void RecordBuffer::grow( std::size_t required )
+		{
+			const std::size_t used = size();
+			const std::size_t capacity = std::max( std::max( 2 * static_cast<std::size_t>( epptr() - pbase() ),
+			                                                 RECORD_BUFFER_INITIAL_CAPACITY ),
+			                                       used + required );
+			char *storage = new char[capacity];
+			if( used > 0 )
+			{
+				std::memcpy( storage, pbase(), used );
+			}
+			delete[] pbase();
+			setp( storage, storage + capacity );
+			pbump( static_cast<int>( used ) );
+		}
+
+		EINHARD_INLINE_ void RecordBuffer::shrink() noexcept
+		{
+			delete[] pbase();
+			setp( nullptr, nullptr );
+			std::string().swap( output );
+		}
+
+		EINHARD_INLINE_ RecordBuffer::int_type RecordBuffer::overflow( int_type c )
+		{
+			if( traits_type::eq_int_type( c, traits_type::eof() ) )
+			{
+				return traits_type::not_eof( c );
+			}
+			grow( 1 );
+			*pptr() = traits_type::to_char_type( c );
+			pbump( 1 );
+			return c;
+		}
+
+		EINHARD_INLINE_ std::streamsize RecordBuffer::xsputn( const char *s, std::streamsize n )
+		{
+			if( n <= 0 )
+			{
+				return 0;
+			}
+			if( epptr() - pptr() < n )
+			{
+				grow( static_cast<std::size_t>( n ) );
+			}
+			std::memcpy( pptr(), s, static_cast<std::size_t>( n ) );
+			pbump( static_cast<int>( n ) );
+			return n;
+		}
+
+		EINHARD_INLINE_ RecordBuffer *takeRecordBuffer()
+		{
+			RecordBufferPool &pool = recordBufferPool();
+			{
+				std::lock_guard<std::mutex> lock( pool.mutex );
+				if( RecordBuffer *buffer = pool.pooled )
+				{
+					pool.pooled = buffer->next;
+					buffer->next = nullptr;
+					--pool.pooledBuffers;
+					pool.pooledBytes -= buffer->accounted;
+					return buffer;
+				}
+			}
+			pool.allocated.fetch_add( 1, std::memory_order_relaxed );
+			return new RecordBuffer;
+		}
+
+		// Requires the pool mutex. Unlinks pooled buffers until the pool fits its capacity.
+		EINHARD_INLINE_ RecordBuffer *evictPooledRecordBuffers( RecordBufferPool &pool ) noexcept
+		{
+			const std::size_t capacity = pool.poolCapacity.load( std::memory_order_relaxed );
+			RecordBuffer *evicted = nullptr;
+			while( pool.pooledBytes > capacity && pool.pooled )
+			{
+				RecordBuffer *buffer = pool.pooled;
+				pool.pooled = buffer->next;
+				--pool.pooledBuffers;
+				pool.pooledBytes -= buffer->accounted;
+				buffer->next = evicted;
+				evicted = buffer;
+			}
+			return evicted;
+		}
+
+		EINHARD_INLINE_ void poolRecordBuffer( RecordBuffer *buffer ) noexcept
+		{
+			RecordBufferPool &pool = recordBufferPool();
+			{
+				std::lock_guard<std::mutex> lock( pool.mutex );
+				if( pool.pooledBytes + buffer->accounted <= pool.poolCapacity.load( std::memory_order_relaxed ) )
+				{
+					buffer->next = pool.pooled;
+					pool.pooled = buffer;
+					++pool.pooledBuffers;
+					pool.pooledBytes += buffer->accounted;
+					return;
+				}
+			}
+			delete buffer;
+		}
+
+		EINHARD_INLINE_ void emptyRecordBufferSlot( RecordBufferSlot &slot ) noexcept
+		{
+			if( slot.buffer )
+			{
+				slot.buffer->slot = nullptr;
+				poolRecordBuffer( slot.buffer );
+				slot.buffer = nullptr;
+			}
+		}
+
+#ifndef EINHARD_NO_THREAD_LOCAL
+		struct ThreadRecordBuffer
+		{
+			RecordBufferSlot slot;
+			~ThreadRecordBuffer()
+			{
+				emptyRecordBufferSlot( slot );
+			}
+		};
+
+		EINHARD_INLINE_ RecordBufferSlot &threadRecordBuffer() noexcept
+		{
+			static thread_local ThreadRecordBuffer buffer;
+			return buffer.slot;
+		}
+#endif
+
+		EINHARD_INLINE_ RecordBuffer *acquireRecordBuffer( TaskContext *task )
+		{
+			RecordBufferSlot *slot = nullptr;
+			if( task )
+			{
+				slot = &task->buffer;
+			}
+#ifndef EINHARD_NO_THREAD_LOCAL
+			else
+			{
+				slot = &threadRecordBuffer();
+			}
+#endif
+			if( slot && !slot->inUse )
+			{
+				if( !slot->buffer )
+				{
+					slot->buffer = takeRecordBuffer();
+					slot->buffer->slot = slot;
+				}
+				slot->inUse = true;
+				return slot->buffer;
+			}
+			// a record formatted while formatting another one, e.g. by an operator<<
+			return takeRecordBuffer();
+		}
+
+		EINHARD_INLINE_ void releaseRecordBuffer( RecordBuffer *buffer ) noexcept
+		{
+			// manipulators must not affect the next record
+			std::ostream &stream = buffer->stream;
+			stream.clear();
+			stream.flags( std::ios_base::skipws | std::ios_base::dec );
+			stream.width( 0 );
+			stream.precision( 6 );
+			stream.fill( ' ' );
+			buffer->clear();
+
+			RecordBufferPool &pool = recordBufferPool();
+			accountRecordBuffer( *buffer );
+			if( buffer->capacity() > pool.trimCapacity.load( std::memory_order_relaxed ) )
+			{
+				buffer->shrink();
+				accountRecordBuffer( *buffer );
+				pool.trimmed.fetch_add( 1, std::memory_order_relaxed );
+			}
+
+			if( buffer->slot )
+			{
+				buffer->slot->inUse = false;
+				return;
+			}
+			poolRecordBuffer( buffer );
+		}
+
+		EINHARD_INLINE_ void lockRecordBuffersForFork() noexcept
+		{
+			recordBufferPool().mutex.lock();
+		}
+
+		EINHARD_INLINE_ void unlockRecordBuffersAfterFork() noexcept
+		{
+			recordBufferPool().mutex.unlock();
+		}
+	}
+
+	EINHARD_INLINE_ void setRecordBufferLimits( std::size_t trimCapacity, std::size_t poolCapacity ) noexcept
+	{
+		detail::RecordBufferPool &pool = detail::recordBufferPool();
+		detail::RecordBuffer *evicted;
+		{
+			std::lock_guard<std::mutex> lock( pool.mutex );
+			pool.trimCapacity.store( trimCapacity, std::memory_order_relaxed );
+			pool.poolCapacity.store( poolCapacity, std::memory_order_relaxed );
+			evicted = detail::evictPooledRecordBuffers( pool );
+		}
+		while( evicted )
+		{
+			detail::RecordBuffer *next = evicted->next;
+			delete evicted;
+			evicted = next;
+		}
+	}
+
+	EINHARD_INLINE_ RecordBufferStats recordBufferStats() noexcept
+	{
+		detail::RecordBufferPool &pool = detail::recordBufferPool();
+		std::lock_guard<std::mutex> lock( pool.mutex );
+		return {pool.buffers.load( std::memory_order_relaxed ),   pool.bytes.load( std::memory_order_relaxed ),
+		        pool.peakBytes.load( std::memory_order_relaxed ), pool.pooledBuffers,
+		        pool.pooledBytes,                                 pool.allocated.load( std::memory_order_relaxed ),
+		        pool.trimmed.load( std::memory_order_relaxed )};
+	}
+}
+
+// vim: ts=4 sw=4 tw=100 noet
@@ -0,0 +1,592 @@
+/**
+ * @file
+ *
+ * Implementation of the formatting of records and of the sinks.
+ *
+ * Compiled into the Einhard library, or into every translation unit including einhard.hpp if
+ * EINHARD_HEADER_ONLY is defined.
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../einhard.hpp"
+
+#include <atomic>
+#include <ctime>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+
+namespace einhard
+{
+	namespace detail
+	{
+		// Width of "[HH:MM:SS] LEVEL: " on screen
+		const unsigned char HEADER_WIDTH = 18;
+
+		/*
+		 * localtime_r takes a lock of the C library. If another thread holds it while the process
+		 * forks, the child blocks forever on its next call. So the offset of local time from UTC is
+		 * looked up once per quarter of an hour, the time zone transitions happen on, while holding
+		 * a lock that is held across fork() as well.
+		 *
+		 * The cache holds the quarter in the upper bits and the offset plus 2^19 in the lower
+		 * 20 bits, 0 if it is empty.
+		 */
+		const std::time_t LOCAL_TIME_PERIOD = 15 * 60;
+
+		EINHARD_INLINE_ std::atomic<std::uint64_t> &localTimeCache() noexcept
+		{
+			static std::atomic<std::uint64_t> cache{0};
+			return cache;
+		}
+
+		EINHARD_INLINE_ std::mutex &localTimeMutex() noexcept
+		{
+			static std::mutex mutex;
+			return mutex;
+		}
+
+		// The offset of local time from UTC at now, in seconds
+		EINHARD_INLINE_ long localTimeOffset( std::time_t now ) noexcept
+		{
+			const std::uint64_t period = static_cast<std::uint64_t>( now / LOCAL_TIME_PERIOD );
+			std::atomic<std::uint64_t> &cache = localTimeCache();
+			const std::uint64_t cached = cache.load( std::memory_order_relaxed );
+			if( ( cached >> 20 ) == period )
+			{
+				return static_cast<long>( cached & 0xfffff ) - 0x80000;
+			}
+
+			installForkHandlers();
+			tm local;
+			{
+				std::lock_guard<std::mutex> lock( localTimeMutex() );
+				if( !localtime_r( &now, &local ) )
+				{
+					return 0;
+				}
+			}
+			long offset = local.tm_hour * 3600l + local.tm_min * 60 + local.tm_sec - now % 86400;
+			// offsets range from UTC-12 to UTC+14
+			if( offset > 14 * 3600 )
+			{
+				offset -= 86400;
+			}
+			else if( offset < -12 * 3600 )
+			{
+				offset += 86400;
+			}
+			cache.store( period << 20 | static_cast<std::uint64_t>( offset + 0x80000 ), std::memory_order_relaxed );
+			return offset;
+		}
+
+		EINHARD_INLINE_ void lockLocalTimeForFork() noexcept
+		{
+			localTimeMutex().lock();
+		}
+
+		EINHARD_INLINE_ void unlockLocalTimeAfterFork() noexcept
+		{
+			localTimeMutex().unlock();
+		}
+
+		/*
+		 * The number of columns the UTF-8 encoded string \p text occupies on a terminal.
+		 *
+		 * Code points of the east asian wide and fullwidth blocks count twice.
+		 */
+		EINHARD_INLINE_ std::size_t displayWidth( const char *text ) noexcept
+		{
+			std::size_t width = 0;
+			for( const unsigned char *it = reinterpret_cast<const unsigned char *>( text ); *it; )
+			{
+				unsigned int codePoint = *it++;
+				int continuationBytes = 0;
+				if( ( codePoint & 0xc0 ) == 0x80 )
+				{
+					continue;  // stray continuation byte
+				}
+				else if( codePoint >= 0xf0 )
+				{
+					codePoint &= 0x07;
+					continuationBytes = 3;
+				}
+				else if( codePoint >= 0xe0 )
+				{
+					codePoint &= 0x0f;
+					continuationBytes = 2;
+				}
+				else if( codePoint >= 0xc0 )
+				{
+					codePoint &= 0x1f;
+					continuationBytes = 1;
+				}
+				for( ; continuationBytes > 0 && ( *it & 0xc0 ) == 0x80; --continuationBytes, ++it )
+				{
+					codePoint = ( codePoint << 6 ) | ( *it & 0x3f );
+				}
+				const bool wide = ( codePoint >= 0x1100 && codePoint <= 0x115f ) ||
+				                  ( codePoint >= 0x2e80 && codePoint <= 0xa4cf ) ||
+				                  ( codePoint >= 0xac00 && codePoint <= 0xd7a3 ) ||
+				                  ( codePoint >= 0xf900 && codePoint <= 0xfaff ) ||
+				                  ( codePoint >= 0xfe30 && codePoint <= 0xfe4f ) ||
+				                  ( codePoint >= 0xff00 && codePoint <= 0xff60 ) ||
+				                  ( codePoint >= 0xffe0 && codePoint <= 0xffe6 ) ||
+				                  ( codePoint >= 0x20000 && codePoint <= 0x3fffd );
+				width += wide ? 2 : 1;
+			}
+			return width;
+		}
+
+		// nullptr selects the stdout sink. This keeps the selected sink constant-initialized and
+		// thus usable from static initializers in other translation units.
+		EINHARD_INLINE_ std::atomic<Sink *> &selectedSink() noexcept
+		{
+			static std::atomic<Sink *> sink( nullptr );
+			return sink;
+		}
+
+		EINHARD_INLINE_ Sink &stdoutSink() noexcept
+		{
+			static StdioSink sink( stdout );
+			return sink;
+		}
+	}
+
+	EINHARD_INLINE_ Sink::~Sink()
+	{
+		detail::forgetSinkInFlightRecorder( this );
+	}
+
+	EINHARD_INLINE_ void Record::withoutColor( std::string &plain ) const
+	{
+		plain.clear();
+		if( !colored )
+		{
+			plain.assign( data, size );
+			return;
+		}
+		plain.reserve( size );
+		const char *it = data;
+		const char *const end = data + size;
+		while( it < end )
+		{
+			const char *escape = static_cast<const char *>( std::memchr( it, '\33', end - it ) );
+			if( !escape )
+			{
+				plain.append( it, end );
+				break;
+			}
+			plain.append( it, escape );
+			const char *terminator = static_cast<const char *>( std::memchr( escape, 'm', end - escape ) );
+			it = terminator ? terminator + 1 : end;
+		}
+	}
+
+	EINHARD_INLINE_ void StdioSink::write( const Record &record ) noexcept
+	{
+		if( stripColor && record.colored )
+		{
+			try
+			{
+				std::string plain;
+				record.withoutColor( plain );
+				std::fwrite( plain.data(), plain.size(), 1, stream );
+				std::fflush( stream );
+			}
+			catch( std::bad_alloc & )
+			{
+			}
+			return;
+		}
+		std::fwrite( record.data, record.size, 1, stream );
+		std::fflush( stream );  // FIXME: don't want to flush too often, what's the right logic here?
+	}
+
+	EINHARD_INLINE_ Sink *setSink( Sink *sink ) noexcept
+	{
+		Sink *previous = detail::selectedSink().exchange( sink );
+		return previous ? previous : &detail::stdoutSink();
+	}
+
+	EINHARD_INLINE_ Sink &getSink() noexcept
+	{
+		Sink *sink = detail::selectedSink().load( std::memory_order_acquire );
+		return sink ? *sink : detail::stdoutSink();
+	}
+
+	template <> EINHARD_INLINE_ char const *getLogLevelString<ALL>() noexcept
+	{
+		return "  ALL";
+	}
+	template <> EINHARD_INLINE_ char const *getLogLevelString<TRACE>() noexcept
+	{
+		return "TRACE";
+	}
+	template <> EINHARD_INLINE_ char const *getLogLevelString<DEBUG>() noexcept
+	{
+		return "DEBUG";
+	}
+	template <> EINHARD_INLINE_ char const *getLogLevelString<INFO>() noexcept
+	{
+		return " INFO";
+	}
+	template <> EINHARD_INLINE_ char const *getLogLevelString<WARN>() noexcept
+	{
+		return " WARN";
+	}
+	template <> EINHARD_INLINE_ char const *getLogLevelString<ERROR>() noexcept
+	{
+		return "ERROR";
+	}
+	template <> EINHARD_INLINE_ char const *getLogLevelString<FATAL>() noexcept
+	{
+		return "FATAL";
+	}
+	template <> EINHARD_INLINE_ char const *getLogLevelString<OFF>() noexcept
+	{
+		return "  OFF";
+	}
+
+	namespace detail
+	{
+		// splitmix64, used both to seed the per thread generator and to mix the hashes of sample keys
+		inline std::uint64_t mix( std::uint64_t x ) noexcept
+		{
+			x += 0x9e3779b97f4a7c15ull;
+			x = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9ull;
+			x = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebull;
+			return x ^ ( x >> 31 );
+		}
+
+#ifdef EINHARD_NO_THREAD_LOCAL
+		EINHARD_INLINE_ std::uint32_t random32() noexcept
+		{
+			static std::atomic<std::uint64_t> state( 0 );
+			return mix( state.fetch_add( 0x9e3779b97f4a7c15ull, std::memory_order_relaxed ) ) >> 32;
+		}
+#else
+		// xorshift64*, seeded on first use from the address of the thread local state and the time
+		EINHARD_INLINE_ std::uint32_t random32() noexcept
+		{
+			static thread_local std::uint64_t state = 0;
+			std::uint64_t x = state;
+			if( x == 0 )
+			{
+				x = mix( reinterpret_cast<std::uintptr_t>( &state ) ^
+				         static_cast<std::uint64_t>( std::time( nullptr ) ) ) | 1;
+			}
+			x ^= x >> 12;
+			x ^= x << 25;
+			x ^= x >> 27;
+			state = x;
+			return ( x * 0x2545f4914f6cdd1dull ) >> 32;
+		}
+#endif
+
+		inline std::uint64_t sampleThreshold( const SharedConfig &config, LogLevel level ) noexcept
+		{
+			EpochGuard guard;
+			return config.load()->sampleThreshold[level];
+		}
+
+		EINHARD_INLINE_ bool keepSample( const SharedConfig &config, LogLevel level ) noexcept
+		{
+			return random32() < sampleThreshold( config, level );
+		}
+
+		EINHARD_INLINE_ bool keepSample( const SharedConfig &config, LogLevel level,
+		                                 std::uint64_t keyHash ) noexcept
+		{
+			return ( mix( keyHash ) >> 32 ) < sampleThreshold( config, level );
+		}
+	}
+
+	namespace detail
+	{
+		/*
+		 * Appends the size chars of the message s, which ends with a newline, to out, indenting all
+		 * lines but the first by indent spaces.
+		 */
+		EINHARD_INLINE_ void appendIndented( std::string &out, const char *s, std::size_t size, unsigned indent )
+		{
+			const char *const end = s + size;
+			const char *start = s;
+			const char *pos;
+			while( ( pos = static_cast<const char *>( std::memchr( start, '\n', end - start ) ) + 1 ) <
+			       end - 1 )  // the end - 1 catches double \n\n at the end of the string, reducing it to a single \n
+			{
+				out.append( start, pos );
+				out.append( indent, ' ' );
+				start = pos;
+			}
+			out.append( start, pos );
+		}
+
+		EINHARD_INLINE_ const char *colorForLogLevel( LogLevel level ) noexcept
+		{
+			switch( level )
+			{
+			case ALL:
+			case TRACE:
+				return einhard::colorForLogLevel<TRACE>();
+			case DEBUG:
+				return einhard::colorForLogLevel<DEBUG>();
+			case INFO:
+				return einhard::colorForLogLevel<INFO>();
+			case WARN:
+				return einhard::colorForLogLevel<WARN>();
+			case ERROR:
+				return einhard::colorForLogLevel<ERROR>();
+			case FATAL:
+			case OFF:
+				break;
+			}
+			return einhard::colorForLogLevel<FATAL>();
+		}
+	}
+
+	template <LogLevel VERBOSITY>
+	EINHARD_INLINE_ void UnconditionalOutput::doInit( const detail::SharedConfig &sharedConfig )
+	{
+		// The guard keeps the config alive even if the Logger is reconfigured concurrently
+		detail::EpochGuard guard;
+		const detail::LoggerConfig &config = *sharedConfig.load();
+		colorize = config.colorize;
+		sink = config.sink;
+		const char *const areaName = config.areaName;
+		const char time_separator = config.timeSeparator;
+
+		TaskContext *const task = TaskContext::current();
+		buffer = detail::acquireRecordBuffer( task );
+		out = &buffer->stream;
+		level = VERBOSITY;
+		typedef typename LevelColor<VERBOSITY>::type HeaderColor;
+		if( colorize )
+		{
+			// set color according to log level
+			out->write( HeaderColor::ANSI(), HeaderColor::LENGTH );
+		}
+
+		// Figure out current time
+		time_t rawtime;
+		time( &rawtime );
+		const long secondOfDay = ( ( rawtime + detail::localTimeOffset( rawtime ) ) % 86400 + 86400 ) % 86400;
+
+		// output it
+		const auto oldFill = out->fill();
+		out->fill( '0' );
+		*out << '[';
+		*out << std::setw( 2 ) << secondOfDay / 3600;
+		*out << time_separator;
+		*out << std::setw( 2 ) << secondOfDay / 60 % 60;
+		*out << time_separator;
+		*out << std::setw( 2 ) << secondOfDay % 60;
+		*out << ']';
+		out->fill( oldFill );
+		// TODO would be good to have this at least .01 seconds
+		// for non-console output pure timestamp would probably be better
+
+		// output the log level and logging area of the message
+		*out << ' ' << getLogLevelString<VERBOSITY>();
+		indent = detail::HEADER_WIDTH;
+		if( areaName && areaName[0] != '\0' )
+		{
+			*out << ' ';
+			area = buffer->size();
+			*out << areaName;
+			areaSize = buffer->size() - area;
+			indent += 1 + detail::displayWidth( areaName );
+		}
+		*out << ": ";
+
+		if( colorize )
+		{
+			out->write( NoColor_t_::ANSI(), NoColor_t_::LENGTH );
+		}
+		message = buffer->size();
+		if( task && !task->correlationId().empty() )
+		{
+			*out << '[' << task->correlationId() << "] ";
+		}
+	}
+
+	EINHARD_INLINE_ void UnconditionalOutput::doColorReset()
+	{
+		out->write( NoColor_t_::ANSI(), NoColor_t_::LENGTH );
+		resetColor = false;
+		colorActive = false;
+	}
+
+	EINHARD_INLINE_ void UnconditionalOutput::doCleanup() noexcept
+	{
+		if( colorActive )
+		{
+			// don't let colors leak into the following records
+			doColorReset();
+		}
+		*out << '\n';
+		// reused, so formatting a record does not allocate once the buffer is large enough
+		std::string &s2 = buffer->output;
+		s2.clear();
+		s2.reserve( buffer->size() + 18 * 2 );
+		detail::appendIndented( s2, buffer->data(), buffer->size(), indent );
+		// the indent only affects the following lines, not the offsets in the first one
+		const Record record = {level, s2.data(), s2.size(), colorize, message, area, areaSize, indent};
+		if( !detail::captureInFlightRecorder( record, sink ) )
+		{
+			( sink ? *sink : getSink() ).write( record );
+		}
+		detail::releaseRecordBuffer( buffer );
+	}
+
+	EINHARD_INLINE_ Batch::Batch( LogLevel level, bool enabled, const detail::SharedConfig &sharedConfig )
+	    : level( level ), enabled( enabled ), colorize( false ), timeSeparator( ':' ), sink( nullptr ),
+	      indent( detail::HEADER_WIDTH )
+	{
+		if( !enabled )
+		{
+			return;
+		}
+		detail::EpochGuard guard;
+		const detail::LoggerConfig &config = *sharedConfig.load();
+		colorize = config.colorize;
+		timeSeparator = config.timeSeparator;
+		sink = config.sink;
+		headerTail = ' ';
+		headerTail += getLogLevelString( level );
+		// the header only changes with the time, so its layout is the same for all records
+		const std::size_t headerStart = ( colorize ? std::strlen( detail::colorForLogLevel( level ) ) : 0 ) +
+		                                sizeof( "[HH:MM:SS]" ) - 1;
+		if( config.areaName[0] != '\0' )
+		{
+			headerTail += ' ';
+			area = headerStart + headerTail.size();
+			headerTail += config.areaName;
+			areaSize = headerStart + headerTail.size() - area;
+			indent += 1 + detail::displayWidth( config.areaName );
+		}
+		headerTail += ": ";
+		message = headerStart + headerTail.size() + ( colorize ? NoColor_t_::LENGTH : 0 );
+	}
+
+	EINHARD_INLINE_ Batch::Batch( Batch &&rhs )
+	    : level( rhs.level ), enabled( rhs.enabled ), colorize( rhs.colorize ),
+	      timeSeparator( rhs.timeSeparator ), sink( rhs.sink ), headerTail( std::move( rhs.headerTail ) ),
+	      indent( rhs.indent ), area( rhs.area ), areaSize( rhs.areaSize ), message( rhs.message ),
+	      header( std::move( rhs.header ) ), headerTime( rhs.headerTime ),
+	      recordBuffer( rhs.recordBuffer ), buffer( std::move( rhs.buffer ) ), count( rhs.count )
+	{
+		rhs.recordBuffer = nullptr;
+		rhs.buffer.clear();
+		rhs.count = 0;
+	}
+
+	EINHARD_INLINE_ Batch::~Batch()
+	{
+		submit();
+	}
+
+	EINHARD_INLINE_ void Batch::startRecord()
+	{
+		time_t now;
+		time( &now );
+		if( now != headerTime )
+		{
+			const long secondOfDay = ( ( now + detail::localTimeOffset( now ) ) % 86400 + 86400 ) % 86400;
+			const long fields[3] = {secondOfDay / 3600, secondOfDay / 60 % 60, secondOfDay % 60};
+			header.clear();
+			if( colorize )
+			{
+				header += detail::colorForLogLevel( level );
+			}
+			header += '[';
+			for( int i = 0; i < 3; ++i )
+			{
+				if( i > 0 )
+				{
+					header += timeSeparator;
+				}
+				header += static_cast<char>( '0' + fields[i] / 10 );
+				header += static_cast<char>( '0' + fields[i] % 10 );
+			}
+			header += ']';
+			header += headerTail;
+			if( colorize )
+			{
+				header.append( NoColor_t_::ANSI(), NoColor_t_::LENGTH );
+			}
+			headerTime = now;
+		}
+		TaskContext *const task = TaskContext::current();
+		// released with its formatting flags reset, so they do not carry over to the next record
+		recordBuffer = detail::acquireRecordBuffer( task );
+		resetColor = false;
+		colorActive = false;
+		if( task && !task->correlationId().empty() )
+		{
+			recordBuffer->stream << '[' << task->correlationId() << "] ";
+		}
+	}
+
+	EINHARD_INLINE_ void Batch::finishRecord() noexcept
+	{
+		try
+		{
+			if( colorActive )
+			{
+				doColorReset();
+			}
+			recordBuffer->stream << '\n';
+			buffer += header;
+			detail::appendIndented( buffer, recordBuffer->data(), recordBuffer->size(), indent );
+			++count;
+		}
+		catch( std::bad_alloc & )
+		{
+			// the record is lost, but not the ones collected before
+		}
+		detail::releaseRecordBuffer( recordBuffer );
+		recordBuffer = nullptr;
+	}
+
+	EINHARD_INLINE_ void Batch::doColorReset()
+	{
+		recordBuffer->stream.write( NoColor_t_::ANSI(), NoColor_t_::LENGTH );
+		resetColor = false;
+		colorActive = false;
+	}
+
+	EINHARD_INLINE_ void Batch::submit() noexcept
+	{
+		if( buffer.empty() )
+		{
+			return;
+		}
+		const Record record = {level, buffer.data(), buffer.size(), colorize, message, area, areaSize, indent};
+		if( !detail::captureInFlightRecorder( record, sink ) )
+		{
+			( sink ? *sink : getSink() ).write( record );
+		}
+		buffer.clear();
+		count = 0;
+	}
+}
+
+// vim: ts=4 sw=4 tw=100 noet
@@ -0,0 +1,277 @@
+/**
+ * @file
+ *
+ * Implementation of the epoch based reclamation of LoggerConfig objects.
+ *
+ * Compiled into the Einhard library, or into every translation unit including einhard.hpp if
+ * EINHARD_HEADER_ONLY is defined.
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../einhard.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#ifdef EINHARD_NO_THREAD_LOCAL
+#include <pthread.h>
+#endif
+
+namespace einhard
+{
+	namespace detail
+	{
+		/*
+		 * A reader announces the global epoch it has seen when entering a guard. A config retired
+		 * in epoch E can be freed once no reader announces an epoch <= E: readers announcing
+		 * a later epoch entered after the config had been replaced and thus cannot have seen it.
+		 * All operations on the epoch, the announcements and the config pointers are sequentially
+		 * consistent.
+		 */
+		struct ThreadRecord
+		{
+			// the announced epoch, 0 while the thread is not reading
+			std::atomic<std::uint64_t> active{0};
+			// nesting depth of guards, only accessed by the owning thread
+			unsigned depth = 0;
+			// whether a live thread owns this record
+			std::atomic<bool> inUse{true};
+			// the next record in EpochState::threads, never changes once the record is published
+			ThreadRecord *next = nullptr;
+		};
+
+		struct RetiredConfig
+		{
+			const LoggerConfig *config;
+			std::uint64_t epoch;
+		};
+
+		struct EpochState
+		{
+			std::atomic<std::uint64_t> epoch{1};
+			// Records are never freed, but records of finished threads are reused by new threads.
+			std::atomic<ThreadRecord *> threads{nullptr};
+			// Without a record (out of memory) readers fall back to this lock-free counter.
+			std::atomic<unsigned> anonymousReaders{0};
+		};
+
+		// Constant-initialized, thus usable from static initializers in other translation units.
+		EINHARD_INLINE_ EpochState &epochState() noexcept
+		{
+			static EpochState state;
+			return state;
+		}
+
+		// Intentionally leaked, Logger objects with static storage duration retire their configs
+		// during exit.
+		EINHARD_INLINE_ std::mutex &retiredMutex()
+		{
+			static std::mutex *mutex = ( installForkHandlers(), new std::mutex );
+			return *mutex;
+		}
+		EINHARD_INLINE_ std::vector<RetiredConfig> &retiredConfigs()
+		{
+			static std::vector<RetiredConfig> *retired = new std::vector<RetiredConfig>;
+			return *retired;
+		}
+
+		EINHARD_INLINE_ ThreadRecord *acquireRecord() noexcept
+		{
+			EpochState &state = epochState();
+			for( ThreadRecord *record = state.threads.load(); record; record = record->next )
+			{
+				bool inUse = false;
+				if( !record->inUse.load( std::memory_order_relaxed ) &&
+				    record->inUse.compare_exchange_strong( inUse, true ) )
+				{
+					return record;
+				}
+			}
+			ThreadRecord *record = new( std::nothrow ) ThreadRecord();
+			if( !record )
+			{
+				return nullptr;
+			}
+			record->next = state.threads.load();
+			while( !state.threads.compare_exchange_weak( record->next, record ) )
+			{
+			}
+			return record;
+		}
+
+		EINHARD_INLINE_ void releaseRecord( ThreadRecord *record ) noexcept
+		{
+			if( record )
+			{
+				record->inUse.store( false );
+			}
+		}
+
+#ifdef EINHARD_NO_THREAD_LOCAL
+		EINHARD_INLINE_ void releaseRecordOfThread( void *record )
+		{
+			releaseRecord( static_cast<ThreadRecord *>( record ) );
+		}
+
+		EINHARD_INLINE_ pthread_key_t recordKey() noexcept
+		{
+			struct Key
+			{
+				pthread_key_t key;
+				Key()
+				{
+					pthread_key_create( &key, &releaseRecordOfThread );
+				}
+			};
+			static const Key key;
+			return key.key;
+		}
+
+		EINHARD_INLINE_ ThreadRecord *recordOfThisThread() noexcept
+		{
+			ThreadRecord *record = static_cast<ThreadRecord *>( pthread_getspecific( recordKey() ) );
+			if( !record )
+			{
+				record = acquireRecord();
+				pthread_setspecific( recordKey(), record );
+			}
+			return record;
+		}
+#else
+		struct RecordHandle
+		{
+			ThreadRecord *record = nullptr;
+			~RecordHandle()
+			{
+				releaseRecord( record );
+				record = nullptr;
+			}
+		};
+
+		EINHARD_INLINE_ ThreadRecord *recordOfThisThread() noexcept
+		{
+			static thread_local RecordHandle handle;
+			if( !handle.record )
+			{
+				handle.record = acquireRecord();
+			}
+			return handle.record;
+		}
+#endif
+
+		EINHARD_INLINE_ EpochGuard::EpochGuard() noexcept
+		{
+			ThreadRecord *record = recordOfThisThread();
+			if( !record )
+			{
+				++epochState().anonymousReaders;
+				return;
+			}
+			if( record->depth++ == 0 )
+			{
+				record->active.store( epochState().epoch.load() );
+			}
+		}
+
+		EINHARD_INLINE_ EpochGuard::~EpochGuard()
+		{
+			ThreadRecord *record = recordOfThisThread();
+			if( !record )
+			{
+				--epochState().anonymousReaders;
+				return;
+			}
+			if( --record->depth == 0 )
+			{
+				record->active.store( 0 );
+			}
+		}
+
+		EINHARD_INLINE_ void retireConfig( const LoggerConfig *config ) noexcept
+		{
+			if( !config )
+			{
+				return;
+			}
+			EpochState &state = epochState();
+			std::lock_guard<std::mutex> lock( retiredMutex() );
+			std::vector<RetiredConfig> &retired = retiredConfigs();
+			try
+			{
+				retired.push_back( {config, state.epoch.fetch_add( 1 )} );
+			}
+			catch( std::bad_alloc & )
+			{
+				// Better leak the config than risk freeing it while in use
+				return;
+			}
+
+			std::uint64_t oldestActive = UINT64_MAX;
+			for( ThreadRecord *record = state.threads.load(); record; record = record->next )
+			{
+				const std::uint64_t active = record->active.load();
+				if( active != 0 )
+				{
+					oldestActive = std::min( oldestActive, active );
+				}
+			}
+			if( state.anonymousReaders.load() != 0 )
+			{
+				return;
+			}
+
+			auto firstInUse = std::partition( retired.begin(), retired.end(), [oldestActive](
+			                                      const RetiredConfig &r ) { return r.epoch < oldestActive; } );
+			for( auto it = retired.begin(); it != firstInUse; ++it )
+			{
+				delete it->config;
+			}
+			retired.erase( retired.begin(), firstInUse );
+		}
+
+		EINHARD_INLINE_ void lockEpochForFork() noexcept
+		{
+			retiredMutex().lock();
+		}
+
+		EINHARD_INLINE_ void unlockEpochAfterFork( bool child ) noexcept
+		{
+			if( child )
+			{
+				// the records of the threads that did not survive the fork are free again
+				EpochState &state = epochState();
+				ThreadRecord *const own = recordOfThisThread();
+				for( ThreadRecord *record = state.threads.load(); record; record = record->next )
+				{
+					if( record != own )
+					{
+						record->active.store( 0 );
+						releaseRecord( record );
+					}
+				}
+				state.anonymousReaders.store( 0 );
+			}
+			retiredMutex().unlock();
+		}
+	}
+}
+
+// vim: ts=4 sw=4 tw=100 noet
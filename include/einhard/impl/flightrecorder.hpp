@@ -0,0 +1,519 @@
+/**
+ * @file
+ *
+ * Implementation of the flight recorder.
+ *
+ * Compiled into the Einhard library, or into every translation unit including einhard.hpp if
+ * EINHARD_HEADER_ONLY is defined.
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../einhard.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+
+#ifdef EINHARD_NO_THREAD_LOCAL
+#include <pthread.h>
+#endif
+#include <unistd.h>
+
+namespace einhard
+{
+	namespace detail
+	{
+		const std::size_t MAX_FLIGHT_RECORD_SIZE = 4096;
+
+		/*
+		 * The record ring of one thread.
+		 *
+		 * Only the owning thread writes to it, dumps read it concurrently. As in the shared memory
+		 * ring the slot's seq is 2n+1 while record n is being written and 2n+2 once it is complete.
+		 */
+		struct ThreadRing
+		{
+			struct Slot
+			{
+				std::atomic<std::uint64_t> seq;
+				// the Sink of the Logger, nullptr for the one of setSink( Sink * )
+				std::atomic<Sink *> sink;
+				std::int64_t time;
+				std::uint32_t size;
+				std::uint16_t level;
+				std::uint16_t colored;
+				// the layout of the record, see Record, clamped to the stored size
+				std::uint16_t message;
+				std::uint16_t area;
+				std::uint16_t areaSize;
+				std::uint16_t indent;
+			};
+
+			ThreadRing( std::size_t slotCount, std::size_t recordSize )
+			    : slotCount( slotCount ), recordSize( recordSize ),
+			      stride( ( sizeof( Slot ) + recordSize + 7 ) / 8 * 8 ),
+			      storage( new char[slotCount * stride] )
+			{
+				for( std::size_t i = 0; i < slotCount; ++i )
+				{
+					new( &slot( i ) ) Slot();
+					slot( i ).seq.store( 0, std::memory_order_relaxed );
+				}
+			}
+
+			Slot &slot( std::uint64_t n ) noexcept
+			{
+				return *reinterpret_cast<Slot *>( &storage[( n & ( slotCount - 1 ) ) * stride] );
+			}
+			char *data( Slot &s ) noexcept
+			{
+				return reinterpret_cast<char *>( &s ) + sizeof( Slot );
+			}
+
+			const std::size_t slotCount;
+			const std::size_t recordSize;
+			const std::size_t stride;
+			std::unique_ptr<char[]> storage;
+			// the number of records written so far
+			std::atomic<std::uint64_t> head{0};
+			// whether a live thread owns this ring
+			std::atomic<bool> inUse{true};
+			// the next ring in FlightRecorderState::rings, never changes once the ring is published
+			ThreadRing *next = nullptr;
+
+			// only accessed while holding FlightRecorderState::dumping
+			std::uint64_t dumped = 0;
+			std::uint64_t dumpCursor = 0;
+			std::uint64_t dumpEnd = 0;
+		};
+
+		struct FlightRecorderState
+		{
+			// Rings are never freed, but rings of finished threads are reused by new threads.
+			std::atomic<ThreadRing *> rings{nullptr};
+			std::atomic_flag dumping = ATOMIC_FLAG_INIT;
+
+			// Records below captureLevel are captured, ALL disables the flight recorder.
+			std::atomic<int> captureLevel{ALL};
+			std::atomic<int> dumpLevel{OFF};
+			std::atomic<std::size_t> slotCount{0};
+			std::atomic<std::size_t> recordSize{0};
+		};
+
+		// Constant-initialized, thus usable from static initializers and signal handlers.
+		EINHARD_INLINE_ FlightRecorderState &flightRecorderState() noexcept
+		{
+			static FlightRecorderState state;
+			return state;
+		}
+
+		EINHARD_INLINE_ struct sigaction *previousSignalActions() noexcept
+		{
+			static struct sigaction actions[NSIG];
+			return actions;
+		}
+
+		EINHARD_INLINE_ ThreadRing *acquireRing( std::size_t slotCount, std::size_t recordSize ) noexcept
+		{
+			std::atomic<ThreadRing *> &rings = flightRecorderState().rings;
+			for( ThreadRing *ring = rings.load( std::memory_order_acquire ); ring; ring = ring->next )
+			{
+				bool inUse = false;
+				if( ring->slotCount == slotCount && ring->recordSize == recordSize &&
+				    !ring->inUse.load( std::memory_order_relaxed ) &&
+				    ring->inUse.compare_exchange_strong( inUse, true, std::memory_order_acquire ) )
+				{
+					return ring;
+				}
+			}
+			ThreadRing *ring = new( std::nothrow ) ThreadRing( slotCount, recordSize );
+			if( !ring )
+			{
+				return nullptr;
+			}
+			ring->next = rings.load( std::memory_order_relaxed );
+			while( !rings.compare_exchange_weak( ring->next, ring, std::memory_order_release,
+			                                     std::memory_order_relaxed ) )
+			{
+			}
+			return ring;
+		}
+
+		EINHARD_INLINE_ void releaseRing( ThreadRing *ring ) noexcept
+		{
+			if( ring )
+			{
+				ring->inUse.store( false, std::memory_order_release );
+			}
+		}
+
+#ifdef EINHARD_NO_THREAD_LOCAL
+		EINHARD_INLINE_ void releaseRingOfThread( void *ring )
+		{
+			releaseRing( static_cast<ThreadRing *>( ring ) );
+		}
+
+		EINHARD_INLINE_ pthread_key_t ringKey() noexcept
+		{
+			struct Key
+			{
+				pthread_key_t key;
+				Key()
+				{
+					pthread_key_create( &key, &releaseRingOfThread );
+				}
+			};
+			static const Key key;
+			return key.key;
+		}
+
+		// The ring of the calling thread, nullptr if it did not capture any records yet
+		EINHARD_INLINE_ ThreadRing *currentRing() noexcept
+		{
+			return static_cast<ThreadRing *>( pthread_getspecific( ringKey() ) );
+		}
+
+		EINHARD_INLINE_ void setCurrentRing( ThreadRing *ring ) noexcept
+		{
+			pthread_setspecific( ringKey(), ring );
+		}
+#else
+		struct RingHandle
+		{
+			ThreadRing *ring = nullptr;
+			~RingHandle()
+			{
+				releaseRing( ring );
+			}
+		};
+
+		EINHARD_INLINE_ RingHandle &ringHandle() noexcept
+		{
+			static thread_local RingHandle handle;
+			return handle;
+		}
+
+		// The ring of the calling thread, nullptr if it did not capture any records yet
+		EINHARD_INLINE_ ThreadRing *currentRing() noexcept
+		{
+			return ringHandle().ring;
+		}
+
+		EINHARD_INLINE_ void setCurrentRing( ThreadRing *ring ) noexcept
+		{
+			ringHandle().ring = ring;
+		}
+#endif
+
+		EINHARD_INLINE_ ThreadRing *ringOfThisThread() noexcept
+		{
+			const FlightRecorderState &state = flightRecorderState();
+			const std::size_t slotCount = state.slotCount.load( std::memory_order_relaxed );
+			const std::size_t recordSize = state.recordSize.load( std::memory_order_relaxed );
+			ThreadRing *ring = currentRing();
+			if( ring && ring->slotCount == slotCount && ring->recordSize == recordSize )
+			{
+				return ring;
+			}
+			releaseRing( ring );
+			ring = acquireRing( slotCount, recordSize );
+			setCurrentRing( ring );
+			return ring;
+		}
+
+		EINHARD_INLINE_ void capture( const Record &record, Sink *sink ) noexcept
+		{
+			ThreadRing *ring = ringOfThisThread();
+			if( !ring )
+			{
+				return;
+			}
+			const std::uint64_t n = ring->head.load( std::memory_order_relaxed );
+			ThreadRing::Slot &slot = ring->slot( n );
+			slot.seq.store( 2 * n + 1, std::memory_order_relaxed );
+			std::atomic_thread_fence( std::memory_order_release );
+
+			slot.sink.store( sink, std::memory_order_relaxed );
+			slot.time = std::chrono::steady_clock::now().time_since_epoch().count();
+			char *data = ring->data( slot );
+			if( record.size > ring->recordSize )
+			{
+				std::memcpy( data, record.data, ring->recordSize - 1 );
+				data[ring->recordSize - 1] = '\n';
+				slot.size = ring->recordSize;
+			}
+			else
+			{
+				std::memcpy( data, record.data, record.size );
+				slot.size = record.size;
+			}
+			slot.level = record.level;
+			slot.colored = record.colored;
+			const std::size_t area = std::min<std::size_t>( record.area, slot.size );
+			slot.message = static_cast<std::uint16_t>( std::min<std::size_t>( record.message, slot.size ) );
+			slot.area = static_cast<std::uint16_t>( area );
+			slot.areaSize = static_cast<std::uint16_t>( std::min<std::size_t>( record.areaSize, slot.size - area ) );
+			slot.indent = static_cast<std::uint16_t>( std::min<std::size_t>( record.indent, UINT16_MAX ) );
+
+			slot.seq.store( 2 * n + 2, std::memory_order_release );
+			ring->head.store( n + 1, std::memory_order_release );
+		}
+
+		/*
+		 * Merge the records of all rings by time and pass them to emit.
+		 *
+		 * This is async-signal-safe as long as emit is. Concurrent dumps are skipped, which also
+		 * covers a signal arriving during a dump.
+		 */
+		template <typename Emit> void dump( Emit emit ) noexcept
+		{
+			FlightRecorderState &state = flightRecorderState();
+			if( state.dumping.test_and_set( std::memory_order_acquire ) )
+			{
+				return;
+			}
+
+			ThreadRing *const rings = state.rings.load( std::memory_order_acquire );
+			for( ThreadRing *ring = rings; ring; ring = ring->next )
+			{
+				ring->dumpEnd = ring->head.load( std::memory_order_acquire );
+				const std::uint64_t oldest =
+				    ring->dumpEnd > ring->slotCount ? ring->dumpEnd - ring->slotCount : 0;
+				ring->dumpCursor = std::max( ring->dumped, oldest );
+			}
+
+			char buffer[MAX_FLIGHT_RECORD_SIZE];
+			for( ;; )
+			{
+				ThreadRing *best = nullptr;
+				std::int64_t bestTime = 0;
+				for( ThreadRing *ring = rings; ring; ring = ring->next )
+				{
+					for( ; ring->dumpCursor < ring->dumpEnd; ++ring->dumpCursor )
+					{
+						ThreadRing::Slot &slot = ring->slot( ring->dumpCursor );
+						if( slot.seq.load( std::memory_order_acquire ) == 2 * ring->dumpCursor + 2 )
+						{
+							if( !best || slot.time < bestTime )
+							{
+								best = ring;
+								bestTime = slot.time;
+							}
+							break;
+						}
+						// else the record has been overwritten already
+					}
+				}
+				if( !best )
+				{
+					break;
+				}
+
+				const std::uint64_t n = best->dumpCursor++;
+				ThreadRing::Slot &slot = best->slot( n );
+				const std::size_t size = std::min<std::size_t>( slot.size, best->recordSize );
+				const LogLevel level = static_cast<LogLevel>( slot.level );
+				const Record record = {level,        buffer,    size,          slot.colored != 0,
+				                       slot.message, slot.area, slot.areaSize, slot.indent};
+				Sink *const sink = slot.sink.load( std::memory_order_relaxed );
+				std::memcpy( buffer, best->data( slot ), size );
+				std::atomic_thread_fence( std::memory_order_acquire );
+				if( slot.seq.load( std::memory_order_relaxed ) == 2 * n + 2 )
+				{
+					emit( record, sink );
+				}
+			}
+
+			for( ThreadRing *ring = rings; ring; ring = ring->next )
+			{
+				ring->dumped = ring->dumpEnd;
+			}
+			state.dumping.clear( std::memory_order_release );
+		}
+
+		EINHARD_INLINE_ void writeToStdout( const Record &record, Sink * ) noexcept
+		{
+			const char *data = record.data;
+			std::size_t size = record.size;
+			while( size > 0 )
+			{
+				const ssize_t written = ::write( STDOUT_FILENO, data, size );
+				if( written < 0 )
+				{
+					if( errno == EINTR )
+					{
+						continue;
+					}
+					return;
+				}
+				data += written;
+				size -= written;
+			}
+		}
+
+		EINHARD_INLINE_ void writeToSink( const Record &record, Sink *sink ) noexcept
+		{
+			( sink ? *sink : getSink() ).write( record );
+		}
+
+		EINHARD_INLINE_ void handleFlightRecorderSignal( int signum, siginfo_t *info, void *context )
+		{
+			const int savedErrno = errno;
+			dump( &writeToStdout );
+			errno = savedErrno;
+
+			const struct sigaction &previous = previousSignalActions()[signum];
+			if( previous.sa_flags & SA_SIGINFO )
+			{
+				previous.sa_sigaction( signum, info, context );
+			}
+			else if( previous.sa_handler == SIG_IGN )
+			{
+				return;
+			}
+			else if( previous.sa_handler != SIG_DFL )
+			{
+				previous.sa_handler( signum );
+			}
+			else if( signum != SIGUSR1 && signum != SIGUSR2 )
+			{
+				std::signal( signum, SIG_DFL );
+				std::raise( signum );
+			}
+		}
+	}
+
+	namespace detail
+	{
+		EINHARD_INLINE_ void resetFlightRecorderAfterFork() noexcept
+		{
+			FlightRecorderState &state = flightRecorderState();
+			// a dump interrupted by the fork will never be finished
+			state.dumping.clear( std::memory_order_release );
+			// the records of the other threads can still be dumped, their rings can be reused
+			ThreadRing *const own = currentRing();
+			for( ThreadRing *ring = state.rings.load( std::memory_order_acquire ); ring; ring = ring->next )
+			{
+				if( ring != own )
+				{
+					releaseRing( ring );
+				}
+			}
+		}
+	}
+
+	EINHARD_INLINE_ void enableFlightRecorder( LogLevel level, LogLevel dumpLevel,
+	                                           std::size_t recordsPerThread, std::size_t recordSize )
+	{
+		if( recordsPerThread == 0 || ( recordsPerThread & ( recordsPerThread - 1 ) ) != 0 )
+		{
+			throw std::invalid_argument( "enableFlightRecorder: the number of records per thread "
+			                             "must be a power of two" );
+		}
+		if( recordSize == 0 || recordSize > detail::MAX_FLIGHT_RECORD_SIZE )
+		{
+			throw std::invalid_argument( "enableFlightRecorder: the record size must be between 1 "
+			                             "and 4096" );
+		}
+		detail::installForkHandlers();
+		detail::FlightRecorderState &state = detail::flightRecorderState();
+		state.slotCount.store( recordsPerThread, std::memory_order_relaxed );
+		state.recordSize.store( recordSize, std::memory_order_relaxed );
+		state.dumpLevel.store( dumpLevel, std::memory_order_relaxed );
+		state.captureLevel.store( level, std::memory_order_release );
+	}
+
+	EINHARD_INLINE_ void disableFlightRecorder() noexcept
+	{
+		detail::FlightRecorderState &state = detail::flightRecorderState();
+		state.captureLevel.store( ALL, std::memory_order_relaxed );
+		state.dumpLevel.store( OFF, std::memory_order_relaxed );
+	}
+
+	EINHARD_INLINE_ void dumpFlightRecorder() noexcept
+	{
+		detail::dump( &detail::writeToSink );
+	}
+
+	EINHARD_INLINE_ bool installFlightRecorderSignalHandler( int signum ) noexcept
+	{
+		if( signum <= 0 || signum >= NSIG )
+		{
+			return false;
+		}
+		struct sigaction action;
+		std::memset( &action, 0, sizeof( action ) );
+		action.sa_sigaction = &detail::handleFlightRecorderSignal;
+		action.sa_flags = SA_SIGINFO | SA_RESTART;
+		sigemptyset( &action.sa_mask );
+		struct sigaction previous;
+		if( sigaction( signum, &action, &previous ) != 0 )
+		{
+			return false;
+		}
+		// installing the handler twice must not make it chain to itself
+		if( !( previous.sa_flags & SA_SIGINFO ) || previous.sa_sigaction != &detail::handleFlightRecorderSignal )
+		{
+			detail::previousSignalActions()[signum] = previous;
+		}
+		return true;
+	}
+
+	namespace detail
+	{
+		EINHARD_INLINE_ bool captureInFlightRecorder( const Record &record, Sink *sink ) noexcept
+		{
+			const FlightRecorderState &state = flightRecorderState();
+			if( record.level < state.captureLevel.load( std::memory_order_relaxed ) )
+			{
+				capture( record, sink );
+				return true;
+			}
+			if( record.level >= state.dumpLevel.load( std::memory_order_relaxed ) )
+			{
+				dumpFlightRecorder();
+			}
+			return false;
+		}
+
+		EINHARD_INLINE_ void forgetSinkInFlightRecorder( const Sink *sink ) noexcept
+		{
+			for( ThreadRing *ring = flightRecorderState().rings.load( std::memory_order_acquire ); ring;
+			     ring = ring->next )
+			{
+				for( std::size_t i = 0; i < ring->slotCount; ++i )
+				{
+					std::atomic<Sink *> &slotSink = ring->slot( i ).sink;
+					if( slotSink.load( std::memory_order_relaxed ) == sink )
+					{
+						slotSink.store( nullptr, std::memory_order_relaxed );
+					}
+				}
+			}
+		}
+	}
+}
+
+// vim: ts=4 sw=4 tw=100 noet
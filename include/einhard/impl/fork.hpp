@@ -0,0 +1,128 @@
+/**
+ * @file
+ *
+ * Implementation of the handling of fork().
+ *
+ * Compiled into the Einhard library, or into every translation unit including einhard.hpp if
+ * EINHARD_HEADER_ONLY is defined.
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../einhard.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include <pthread.h>
+
+namespace einhard
+{
+	namespace detail
+	{
+		struct ForkState
+		{
+			std::mutex mutex;
+			std::vector<ForkHandler *> handlers;
+		};
+
+		// Intentionally leaked, handlers with static storage duration unregister during exit.
+		EINHARD_INLINE_ ForkState &forkState()
+		{
+			static ForkState *state = new ForkState;
+			return *state;
+		}
+
+		/*
+		 * Einhard's own locks are taken before the ones of the handlers: a thread dumping the
+		 * flight recorder or reconfiguring a Logger may write to a Sink, but a Sink never calls
+		 * back into Einhard.
+		 */
+		EINHARD_INLINE_ void atForkPrepare()
+		{
+			ForkState &state = forkState();
+			state.mutex.lock();
+			lockTreeForFork();
+			lockEpochForFork();
+			lockLocalTimeForFork();
+			lockRecordBuffersForFork();
+			// records buffered by stdio would be written by both processes
+			std::fflush( stdout );
+			std::for_each( state.handlers.rbegin(), state.handlers.rend(),
+			               []( ForkHandler *handler ) { handler->prepareFork(); } );
+		}
+
+		EINHARD_INLINE_ void atForkParent()
+		{
+			ForkState &state = forkState();
+			for( ForkHandler *handler : state.handlers )
+			{
+				handler->afterForkInParent();
+			}
+			unlockRecordBuffersAfterFork();
+			unlockLocalTimeAfterFork();
+			unlockEpochAfterFork( false );
+			unlockTreeAfterFork();
+			state.mutex.unlock();
+		}
+
+		EINHARD_INLINE_ void atForkChild()
+		{
+			ForkState &state = forkState();
+			resetFlightRecorderAfterFork();
+			unlockRecordBuffersAfterFork();
+			unlockLocalTimeAfterFork();
+			unlockEpochAfterFork( true );
+			unlockTreeAfterFork();
+			for( ForkHandler *handler : state.handlers )
+			{
+				handler->afterForkInChild();
+			}
+			state.mutex.unlock();
+		}
+
+		EINHARD_INLINE_ void installForkHandlers() noexcept
+		{
+			static const bool installed = pthread_atfork( &atForkPrepare, &atForkParent, &atForkChild ) == 0;
+			static_cast<void>( installed );
+		}
+	}
+
+	EINHARD_INLINE_ ForkHandler::~ForkHandler()
+	{
+	}
+
+	EINHARD_INLINE_ void registerForkHandler( ForkHandler *handler )
+	{
+		detail::installForkHandlers();
+		detail::ForkState &state = detail::forkState();
+		std::lock_guard<std::mutex> lock( state.mutex );
+		state.handlers.push_back( handler );
+	}
+
+	EINHARD_INLINE_ void unregisterForkHandler( ForkHandler *handler ) noexcept
+	{
+		detail::ForkState &state = detail::forkState();
+		std::lock_guard<std::mutex> lock( state.mutex );
+		state.handlers.erase( std::remove( state.handlers.begin(), state.handlers.end(), handler ),
+		                      state.handlers.end() );
+	}
+}
+
+// vim: ts=4 sw=4 tw=100 noet
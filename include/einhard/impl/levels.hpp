@@ -0,0 +1,166 @@
+/**
+ * @file
+ *
+ * Implementation of the names of the LogLevel enumerators and their parsing.
+ *
+ * Compiled into the Einhard library, or into every translation unit including einhard.hpp if
+ * EINHARD_HEADER_ONLY is defined.
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../einhard.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace einhard
+{
+	namespace detail
+	{
+		// Indexed by LogLevel
+		constexpr const char *PADDED_LEVEL_NAMES[] = {"  ALL", "TRACE", "DEBUG", " INFO",
+		                                              " WARN", "ERROR", "FATAL", "  OFF"};
+		constexpr const char *LEVEL_NAMES[] = {"ALL", "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL", "OFF"};
+
+		struct LevelAlias
+		{
+			const char *name;
+			std::size_t size;
+			LogLevel level;
+		};
+
+		// The lowercase names accepted by parseLogLevel()
+		constexpr LevelAlias LEVEL_ALIASES[] = {
+		    {"all", 3, ALL},
+		    {"trace", 5, TRACE},
+		    {"debug", 5, DEBUG},   {"dbg", 3, DEBUG},
+		    {"info", 4, INFO},     {"information", 11, INFO},
+		    {"warn", 4, WARN},     {"warning", 7, WARN},
+		    {"error", 5, ERROR},   {"err", 3, ERROR},
+		    {"fatal", 5, FATAL},   {"critical", 8, FATAL},     {"crit", 4, FATAL},
+		    {"off", 3, OFF},       {"none", 4, OFF}};
+		constexpr std::size_t LEVEL_ALIAS_COUNT = sizeof( LEVEL_ALIASES ) / sizeof( LEVEL_ALIASES[0] );
+		constexpr std::size_t MAX_LEVEL_ALIAS_SIZE = 11;
+		constexpr std::size_t LEVEL_HASH_SLOTS = 32;
+
+		/*
+		 * A perfect hash of the aliases, so a name is compared to at most one of them. It only
+		 * looks at the size and the first and last char, which must be lowercase.
+		 */
+		constexpr std::size_t levelHash( std::size_t size, unsigned char first, unsigned char last ) noexcept
+		{
+			return ( 3 * size + first + last ) % LEVEL_HASH_SLOTS;
+		}
+
+		constexpr std::size_t aliasHash( std::size_t i ) noexcept
+		{
+			return levelHash( LEVEL_ALIASES[i].size, LEVEL_ALIASES[i].name[0],
+			                  LEVEL_ALIASES[i].name[LEVEL_ALIASES[i].size - 1] );
+		}
+
+		constexpr bool aliasesAreValid( std::size_t i = 0 ) noexcept
+		{
+			return i == LEVEL_ALIAS_COUNT ||
+			       ( LEVEL_ALIASES[i].size <= MAX_LEVEL_ALIAS_SIZE &&
+			         LEVEL_ALIASES[i].name[LEVEL_ALIASES[i].size] == '\0' && aliasesAreValid( i + 1 ) );
+		}
+
+		constexpr bool hashIsPerfect( std::size_t i = 0, std::size_t j = 1 ) noexcept
+		{
+			return i + 1 >= LEVEL_ALIAS_COUNT ||
+			       ( j == LEVEL_ALIAS_COUNT ? hashIsPerfect( i + 1, i + 2 )
+			                                : aliasHash( i ) != aliasHash( j ) && hashIsPerfect( i, j + 1 ) );
+		}
+
+		static_assert( aliasesAreValid(), "the size of a LogLevel alias is wrong" );
+		static_assert( hashIsPerfect(), "levelHash() maps two LogLevel aliases to the same slot" );
+
+		// The index of the alias in the given slot, or LEVEL_ALIAS_COUNT if the slot is empty
+		constexpr unsigned char aliasInSlot( std::size_t slot, std::size_t i = 0 ) noexcept
+		{
+			return i == LEVEL_ALIAS_COUNT || aliasHash( i ) == slot ? i : aliasInSlot( slot, i + 1 );
+		}
+
+		constexpr unsigned char LEVEL_HASH_TABLE[LEVEL_HASH_SLOTS] = {
+		    aliasInSlot( 0 ),  aliasInSlot( 1 ),  aliasInSlot( 2 ),  aliasInSlot( 3 ),  aliasInSlot( 4 ),
+		    aliasInSlot( 5 ),  aliasInSlot( 6 ),  aliasInSlot( 7 ),  aliasInSlot( 8 ),  aliasInSlot( 9 ),
+		    aliasInSlot( 10 ), aliasInSlot( 11 ), aliasInSlot( 12 ), aliasInSlot( 13 ), aliasInSlot( 14 ),
+		    aliasInSlot( 15 ), aliasInSlot( 16 ), aliasInSlot( 17 ), aliasInSlot( 18 ), aliasInSlot( 19 ),
+		    aliasInSlot( 20 ), aliasInSlot( 21 ), aliasInSlot( 22 ), aliasInSlot( 23 ), aliasInSlot( 24 ),
+		    aliasInSlot( 25 ), aliasInSlot( 26 ), aliasInSlot( 27 ), aliasInSlot( 28 ), aliasInSlot( 29 ),
+		    aliasInSlot( 30 ), aliasInSlot( 31 )};
+	}
+
+	EINHARD_INLINE_ const char *getLogLevelString( LogLevel level )
+	{
+		return static_cast<unsigned>( level ) <= OFF ? detail::PADDED_LEVEL_NAMES[level] : "";
+	}
+
+	EINHARD_INLINE_ const char *getLogLevelName( LogLevel level ) noexcept
+	{
+		return static_cast<unsigned>( level ) <= OFF ? detail::LEVEL_NAMES[level] : "";
+	}
+
+	EINHARD_INLINE_ bool parseLogLevel( const char *text, std::size_t size, LogLevel &level ) noexcept
+	{
+		if( size == 1 && text[0] >= '0' && text[0] <= '0' + OFF )
+		{
+			level = static_cast<LogLevel>( text[0] - '0' );
+			return true;
+		}
+		if( size == 0 || size > detail::MAX_LEVEL_ALIAS_SIZE )
+		{
+			return false;
+		}
+		char lower[detail::MAX_LEVEL_ALIAS_SIZE];
+		for( std::size_t i = 0; i < size; ++i )
+		{
+			const char c = text[i];
+			lower[i] = c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+		}
+		const std::size_t index = detail::LEVEL_HASH_TABLE[detail::levelHash(
+		    size, static_cast<unsigned char>( lower[0] ), static_cast<unsigned char>( lower[size - 1] ) )];
+		if( index == detail::LEVEL_ALIAS_COUNT )
+		{
+			return false;
+		}
+		const detail::LevelAlias &alias = detail::LEVEL_ALIASES[index];
+		if( alias.size != size || std::memcmp( alias.name, lower, size ) != 0 )
+		{
+			return false;
+		}
+		level = alias.level;
+		return true;
+	}
+
+	EINHARD_INLINE_ LogLevel getLogLevel( const std::string &level )
+	{
+		LogLevel result;
+		if( !parseLogLevel( level.data(), level.size(), result ) )
+		{
+			throw std::invalid_argument( "invalid logging level " + level +
+			                             ". Accepted values are ALL, TRACE, DEBUG, "
+			                             "INFO, WARN, ERROR, FATAL, and OFF." );
+		}
+		return result;
+	}
+}
+
+// vim: ts=4 sw=4 tw=100 noet
@@ -0,0 +1,219 @@
+/**
+ * @file
+ *
+ * Implementation of the encoding of binary payloads.
+ *
+ * Compiled into the Einhard library, or into every translation unit including einhard.hpp if
+ * EINHARD_HEADER_ONLY is defined.
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../einhard.hpp"
+
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace einhard
+{
+	namespace detail
+	{
+		EINHARD_INLINE_ std::atomic<std::size_t> &payloadLimitState() noexcept
+		{
+			static std::atomic<std::size_t> limit{4096};
+			return limit;
+		}
+
+		/*
+		 * Writes the 2 * size lowercase hex digits of the bytes at in to out. With SSE2 16 bytes
+		 * are encoded at once: each nibble n becomes '0' + n, plus the distance from '9' + 1 to
+		 * 'a' if n > 9.
+		 */
+		EINHARD_INLINE_ void encodeHex( const unsigned char *in, std::size_t size, char *out ) noexcept
+		{
+			std::size_t i = 0;
+#ifdef __SSE2__
+			const __m128i nibbleMask = _mm_set1_epi8( 0x0f );
+			const __m128i nine = _mm_set1_epi8( 9 );
+			const __m128i zero = _mm_set1_epi8( '0' );
+			const __m128i letterOffset = _mm_set1_epi8( 'a' - '9' - 1 );
+			for( ; i + 16 <= size; i += 16 )
+			{
+				const __m128i bytes = _mm_loadu_si128( reinterpret_cast<const __m128i *>( in + i ) );
+				const __m128i high = _mm_and_si128( _mm_srli_epi16( bytes, 4 ), nibbleMask );
+				const __m128i low = _mm_and_si128( bytes, nibbleMask );
+				__m128i digits[2] = {_mm_unpacklo_epi8( high, low ), _mm_unpackhi_epi8( high, low )};
+				for( __m128i &d : digits )
+				{
+					const __m128i letters = _mm_and_si128( _mm_cmpgt_epi8( d, nine ), letterOffset );
+					d = _mm_add_epi8( _mm_add_epi8( d, zero ), letters );
+				}
+				_mm_storeu_si128( reinterpret_cast<__m128i *>( out + 2 * i ), digits[0] );
+				_mm_storeu_si128( reinterpret_cast<__m128i *>( out + 2 * i + 16 ), digits[1] );
+			}
+#endif
+			static const char DIGITS[] = "0123456789abcdef";
+			for( ; i < size; ++i )
+			{
+				out[2 * i] = DIGITS[in[i] >> 4];
+				out[2 * i + 1] = DIGITS[in[i] & 0x0f];
+			}
+		}
+
+		EINHARD_INLINE_ bool isPrintable( unsigned char c ) noexcept
+		{
+			return c >= 0x20 && c < 0x7f;
+		}
+
+		EINHARD_INLINE_ void writeHex( std::ostream &out, const unsigned char *data, std::size_t size )
+		{
+			// encoded in chunks to keep the stack usage bounded
+			char buffer[512];
+			for( std::size_t done = 0; done < size; )
+			{
+				const std::size_t chunk = std::min( size - done, sizeof( buffer ) / 2 );
+				encodeHex( data + done, chunk, buffer );
+				out.write( buffer, 2 * chunk );
+				done += chunk;
+			}
+		}
+
+		// Lines like "00000010  2e 2f 30 31 32 33 34 35  36 37 38 39 3a 3b 3c 3d  |./0123456789:;<=|"
+		EINHARD_INLINE_ void writeHexdump( std::ostream &out, const unsigned char *data, std::size_t size )
+		{
+			static const char DIGITS[] = "0123456789abcdef";
+			char line[80];
+			for( std::size_t offset = 0; offset < size; offset += 16 )
+			{
+				const std::size_t count = std::min<std::size_t>( size - offset, 16 );
+				char *p = line;
+				*p++ = '\n';
+				for( int shift = 28; shift >= 0; shift -= 4 )
+				{
+					*p++ = DIGITS[( offset >> shift ) & 0x0f];
+				}
+				*p++ = ' ';
+				char digits[32];
+				encodeHex( data + offset, count, digits );
+				for( std::size_t i = 0; i < 16; ++i )
+				{
+					*p++ = ' ';
+					if( i == 8 )
+					{
+						*p++ = ' ';
+					}
+					*p++ = i < count ? digits[2 * i] : ' ';
+					*p++ = i < count ? digits[2 * i + 1] : ' ';
+				}
+				*p++ = ' ';
+				*p++ = ' ';
+				*p++ = '|';
+				for( std::size_t i = 0; i < count; ++i )
+				{
+					*p++ = isPrintable( data[offset + i] ) ? static_cast<char>( data[offset + i] ) : '.';
+				}
+				*p++ = '|';
+				out.write( line, p - line );
+			}
+		}
+
+		EINHARD_INLINE_ void writeBlob( std::ostream &out, const unsigned char *data, std::size_t size )
+		{
+			static const char DIGITS[] = "0123456789abcdef";
+			char buffer[512];
+			std::size_t used = 0;
+			for( std::size_t i = 0; i < size; ++i )
+			{
+				// the longest escape sequence has four chars
+				if( used > sizeof( buffer ) - 4 )
+				{
+					out.write( buffer, used );
+					used = 0;
+				}
+				const unsigned char c = data[i];
+				if( isPrintable( c ) && c != '\\' )
+				{
+					buffer[used++] = static_cast<char>( c );
+					continue;
+				}
+				buffer[used++] = '\\';
+				switch( c )
+				{
+				case '\\':
+					buffer[used++] = '\\';
+					break;
+				case '\n':
+					buffer[used++] = 'n';
+					break;
+				case '\r':
+					buffer[used++] = 'r';
+					break;
+				case '\t':
+					buffer[used++] = 't';
+					break;
+				default:
+					buffer[used++] = 'x';
+					buffer[used++] = DIGITS[c >> 4];
+					buffer[used++] = DIGITS[c & 0x0f];
+				}
+			}
+			out.write( buffer, used );
+		}
+	}
+
+	EINHARD_INLINE_ void setPayloadLimit( std::size_t bytes ) noexcept
+	{
+		detail::payloadLimitState().store( bytes, std::memory_order_relaxed );
+	}
+
+	EINHARD_INLINE_ std::size_t payloadLimit() noexcept
+	{
+		return detail::payloadLimitState().load( std::memory_order_relaxed );
+	}
+
+	EINHARD_INLINE_ std::ostream &operator<<( std::ostream &out, const Payload &payload )
+	{
+		const std::size_t shown = std::min( payload.size, payload.limit );
+		switch( payload.format )
+		{
+		case Payload::HEX:
+			detail::writeHex( out, payload.data, shown );
+			break;
+		case Payload::HEXDUMP:
+			detail::writeHexdump( out, payload.data, shown );
+			if( shown < payload.size )
+			{
+				out << '\n';
+			}
+			break;
+		case Payload::BLOB:
+			detail::writeBlob( out, payload.data, shown );
+			break;
+		}
+		if( shown < payload.size )
+		{
+			out << "... (" << payload.size - shown << " more bytes)";
+		}
+		return out;
+	}
+}
+
+// vim: ts=4 sw=4 tw=100 noet
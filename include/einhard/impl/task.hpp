@@ -0,0 +1,132 @@
+/**
+ * @file
+ *
+ * Implementation of the logging context of logical tasks.
+ *
+ * Compiled into the Einhard library, or into every translation unit including einhard.hpp if
+ * EINHARD_HEADER_ONLY is defined.
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../einhard.hpp"
+
+#include <utility>
+
+#ifdef EINHARD_NO_THREAD_LOCAL
+#include <pthread.h>
+#endif
+
+namespace einhard
+{
+	namespace detail
+	{
+#ifdef EINHARD_NO_THREAD_LOCAL
+		EINHARD_INLINE_ pthread_key_t currentTaskKey() noexcept
+		{
+			struct Key
+			{
+				pthread_key_t key;
+				Key()
+				{
+					pthread_key_create( &key, nullptr );
+				}
+			};
+			static const Key key;
+			return key.key;
+		}
+
+		EINHARD_INLINE_ TaskContext *currentTask() noexcept
+		{
+			return static_cast<TaskContext *>( pthread_getspecific( currentTaskKey() ) );
+		}
+
+		EINHARD_INLINE_ void setCurrentTask( TaskContext *task ) noexcept
+		{
+			pthread_setspecific( currentTaskKey(), task );
+		}
+#else
+		EINHARD_INLINE_ TaskContext *&currentTaskOfThread() noexcept
+		{
+			static thread_local TaskContext *task = nullptr;
+			return task;
+		}
+
+		EINHARD_INLINE_ TaskContext *currentTask() noexcept
+		{
+			return currentTaskOfThread();
+		}
+
+		EINHARD_INLINE_ void setCurrentTask( TaskContext *task ) noexcept
+		{
+			currentTaskOfThread() = task;
+		}
+#endif
+	}
+
+	EINHARD_INLINE_ TaskContext::TaskContext( std::string correlationId ) : id( std::move( correlationId ) )
+	{
+		// enough for the usual nesting, so enter() rarely allocates
+		previous.reserve( 4 );
+	}
+
+	EINHARD_INLINE_ TaskContext::~TaskContext()
+	{
+		detail::emptyRecordBufferSlot( buffer );
+	}
+
+	EINHARD_INLINE_ void TaskContext::enter()
+	{
+		previous.push_back( detail::currentTask() );
+		detail::setCurrentTask( this );
+	}
+
+	EINHARD_INLINE_ void TaskContext::leave() noexcept
+	{
+		assert( !previous.empty() && "leave() without enter()" );
+		detail::setCurrentTask( previous.back() );
+		previous.pop_back();
+		assert( ( !previous.empty() || !buffer.inUse ) &&
+		        "a record must be complete before its task leaves the thread" );
+	}
+
+	EINHARD_INLINE_ bool TaskContext::detach() noexcept
+	{
+		if( previous.empty() )
+		{
+			return false;
+		}
+		assert( !buffer.inUse && "a record must be complete before its task leaves the thread" );
+		detail::setCurrentTask( previous.front() );
+		return true;
+	}
+
+	EINHARD_INLINE_ void TaskContext::attach() noexcept
+	{
+		// the inner entries refer to this context or ones entered within it, not to the thread
+		previous.front() = detail::currentTask();
+		detail::setCurrentTask( this );
+	}
+
+	EINHARD_INLINE_ TaskContext *TaskContext::current() noexcept
+	{
+		return detail::currentTask();
+	}
+}
+
+// vim: ts=4 sw=4 tw=100 noet
@@ -0,0 +1,306 @@
+/**
+ * @file
+ *
+ * Implementation of the hierarchy of Logger names.
+ *
+ * Compiled into the Einhard library, or into every translation unit including einhard.hpp if
+ * EINHARD_HEADER_ONLY is defined.
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../einhard.hpp"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace einhard
+{
+	namespace detail
+	{
+		struct AttachedLogger
+		{
+			void *logger;
+			TreeRefresh refresh;
+		};
+
+		/*
+		 * A name of the hierarchy. Nodes are never freed.
+		 *
+		 * The settings in effect for a node are resolved from its ancestors once and cached until
+		 * the generation of the tree changes, i.e. until any node is reconfigured.
+		 */
+		struct TreeNode
+		{
+			TreeNode( const std::string &name, TreeNode *parent ) : name( name ), parent( parent )
+			{
+			}
+
+			const std::string name;
+			TreeNode *const parent;
+			std::vector<TreeNode *> children;
+			std::vector<AttachedLogger> loggers;
+
+			// the settings of this node, used instead of the ones of the parent if set
+			bool hasVerbosity = false;
+			bool hasColorize = false;
+			bool hasSink = false;
+			TreeSettings own = {WARN, false, nullptr};
+
+			// the settings in effect and the generation they have been resolved in
+			std::uint64_t generation = 0;
+			TreeSettings effective = {WARN, false, nullptr};
+		};
+
+		struct TreeState
+		{
+			std::mutex mutex;
+			std::map<std::string, TreeNode *> nodes;
+			std::uint64_t generation = 1;
+		};
+
+		// Intentionally leaked, Logger objects with static storage duration detach during exit.
+		EINHARD_INLINE_ TreeState &treeState()
+		{
+			static TreeState *state = ( installForkHandlers(), new TreeState );
+			return *state;
+		}
+
+		EINHARD_INLINE_ void resetRootSettings( TreeNode &root ) noexcept
+		{
+			root.hasVerbosity = root.hasColorize = root.hasSink = true;
+			root.own.verbosity = WARN;
+			root.own.colorize = isatty( fileno( stdout ) );
+			root.own.sink = nullptr;
+		}
+
+		// Requires the tree mutex
+		EINHARD_INLINE_ TreeNode *findOrCreateNode( TreeState &state, const std::string &name )
+		{
+			std::map<std::string, TreeNode *>::iterator it = state.nodes.find( name );
+			if( it != state.nodes.end() )
+			{
+				return it->second;
+			}
+			TreeNode *parent = nullptr;
+			if( !name.empty() )
+			{
+				const std::string::size_type dot = name.rfind( '.' );
+				parent = findOrCreateNode( state, dot == std::string::npos ? std::string() : name.substr( 0, dot ) );
+			}
+			TreeNode *node = new TreeNode( name, parent );
+			if( parent )
+			{
+				parent->children.push_back( node );
+			}
+			else
+			{
+				resetRootSettings( *node );
+			}
+			state.nodes.insert( std::make_pair( name, node ) );
+			return node;
+		}
+
+		// Requires the tree mutex. Does not create nodes, so looking up arbitrary names leaks nothing.
+		EINHARD_INLINE_ TreeNode *findNearestNode( TreeState &state, std::string name )
+		{
+			for( ;; )
+			{
+				std::map<std::string, TreeNode *>::iterator it = state.nodes.find( name );
+				if( it != state.nodes.end() )
+				{
+					return it->second;
+				}
+				if( name.empty() )
+				{
+					return findOrCreateNode( state, name );
+				}
+				const std::string::size_type dot = name.rfind( '.' );
+				name.erase( dot == std::string::npos ? 0 : dot );
+			}
+		}
+
+		// Requires the tree mutex. O(1) unless an ancestor has changed since the last call.
+		EINHARD_INLINE_ const TreeSettings &effectiveSettings( const TreeState &state, TreeNode &node ) noexcept
+		{
+			if( node.generation != state.generation )
+			{
+				TreeSettings settings = node.parent ? effectiveSettings( state, *node.parent ) : node.own;
+				if( node.hasVerbosity )
+				{
+					settings.verbosity = node.own.verbosity;
+				}
+				if( node.hasColorize )
+				{
+					settings.colorize = node.own.colorize;
+				}
+				if( node.hasSink )
+				{
+					settings.sink = node.own.sink;
+				}
+				node.effective = settings;
+				node.generation = state.generation;
+			}
+			return node.effective;
+		}
+
+		// Requires the tree mutex
+		EINHARD_INLINE_ void refreshSubtree( const TreeState &state, TreeNode &node )
+		{
+			const TreeSettings &settings = effectiveSettings( state, node );
+			for( const AttachedLogger &attached : node.loggers )
+			{
+				attached.refresh( attached.logger, settings );
+			}
+			for( TreeNode *child : node.children )
+			{
+				refreshSubtree( state, *child );
+			}
+		}
+
+		template <typename F> void reconfigureNode( const std::string &name, F modify )
+		{
+			TreeState &state = treeState();
+			std::lock_guard<std::mutex> lock( state.mutex );
+			TreeNode &node = *findOrCreateNode( state, name );
+			modify( node );
+			++state.generation;
+			refreshSubtree( state, node );
+		}
+
+		EINHARD_INLINE_ void attachToNode( TreeNode *node, void *logger, TreeRefresh refresh )
+		{
+			TreeState &state = treeState();
+			std::lock_guard<std::mutex> lock( state.mutex );
+			node->loggers.push_back( {logger, refresh} );
+			refresh( logger, effectiveSettings( state, *node ) );
+		}
+
+		EINHARD_INLINE_ TreeNode *attachToTree( const std::string &name, void *logger, TreeRefresh refresh )
+		{
+			TreeNode *node;
+			{
+				TreeState &state = treeState();
+				std::lock_guard<std::mutex> lock( state.mutex );
+				node = findOrCreateNode( state, name );
+			}
+			attachToNode( node, logger, refresh );
+			return node;
+		}
+
+		EINHARD_INLINE_ void detachFromTree( TreeNode *node, void *logger ) noexcept
+		{
+			TreeState &state = treeState();
+			std::lock_guard<std::mutex> lock( state.mutex );
+			std::vector<AttachedLogger> &loggers = node->loggers;
+			loggers.erase( std::remove_if( loggers.begin(), loggers.end(),
+			                               [logger]( const AttachedLogger &a ) { return a.logger == logger; } ),
+			               loggers.end() );
+		}
+
+		EINHARD_INLINE_ void lockTreeForFork() noexcept
+		{
+			treeState().mutex.lock();
+		}
+
+		EINHARD_INLINE_ void unlockTreeAfterFork() noexcept
+		{
+			treeState().mutex.unlock();
+		}
+	}
+
+	EINHARD_INLINE_ void setVerbosity( const std::string &name, LogLevel verbosity )
+	{
+		detail::reconfigureNode( name, [verbosity]( detail::TreeNode &node ) {
+			node.hasVerbosity = true;
+			node.own.verbosity = verbosity;
+		} );
+	}
+
+	EINHARD_INLINE_ bool setVerbosities( const std::string &specs, std::size_t *errorOffset )
+	{
+		std::vector<std::pair<std::string, LogLevel>> parsed;
+		if( !parseLevelSpecs( specs,
+		                      [&parsed]( const char *area, std::size_t size, LogLevel level ) {
+			                      parsed.emplace_back( std::string( area, size ), level );
+		                      },
+		                      errorOffset ) )
+		{
+			return false;
+		}
+		if( parsed.empty() )
+		{
+			return true;
+		}
+		detail::TreeState &state = detail::treeState();
+		std::lock_guard<std::mutex> lock( state.mutex );
+		for( const std::pair<std::string, LogLevel> &spec : parsed )
+		{
+			detail::TreeNode &node = *detail::findOrCreateNode( state, spec.first );
+			node.hasVerbosity = true;
+			node.own.verbosity = spec.second;
+		}
+		++state.generation;
+		// cheaper than refreshing the subtree of each name if many of them are nested
+		detail::refreshSubtree( state, *detail::findOrCreateNode( state, std::string() ) );
+		return true;
+	}
+
+	EINHARD_INLINE_ void setColorize( const std::string &name, bool colorize )
+	{
+		detail::reconfigureNode( name, [colorize]( detail::TreeNode &node ) {
+			node.hasColorize = true;
+			node.own.colorize = colorize;
+		} );
+	}
+
+	EINHARD_INLINE_ void setSink( const std::string &name, Sink *sink )
+	{
+		detail::reconfigureNode( name, [sink]( detail::TreeNode &node ) {
+			node.hasSink = true;
+			node.own.sink = sink;
+		} );
+	}
+
+	EINHARD_INLINE_ void resetConfiguration( const std::string &name )
+	{
+		detail::reconfigureNode( name, []( detail::TreeNode &node ) {
+			if( node.parent )
+			{
+				node.hasVerbosity = node.hasColorize = node.hasSink = false;
+			}
+			else
+			{
+				detail::resetRootSettings( node );
+			}
+		} );
+	}
+
+	EINHARD_INLINE_ LogLevel getVerbosity( const std::string &name )
+	{
+		detail::TreeState &state = detail::treeState();
+		std::lock_guard<std::mutex> lock( state.mutex );
+		// a node that does not exist has the settings of its nearest ancestor
+		return detail::effectiveSettings( state, *detail::findNearestNode( state, name ) ).verbosity;
+	}
+}
+
+// vim: ts=4 sw=4 tw=100 noet
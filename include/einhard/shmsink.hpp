@@ -0,0 +1,163 @@
+/**
+ * @file
+ *
+ * A Sink writing log records into a POSIX shared memory ring buffer.
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "einhard.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace einhard
+{
+	namespace shm
+	{
+		struct Header;
+		struct Slot;
+	}
+
+	/**
+	 * A Sink that copies each record into a slot of a ring buffer living in POSIX shared memory.
+	 *
+	 * The logging process does no I/O at all. Another process, e.g. the einhard-tail tool, attaches
+	 * to the segment using a ShmRingReader and takes care of writing the records somewhere.
+	 *
+	 * Each writer claims a slot by atomically incrementing the ring's sequence counter. The slot
+	 * carries a sequence number which is odd while the record is being copied and identifies
+	 * the record once it is complete. The ring never blocks the writers: if the reader is too slow
+	 * old records are overwritten, which the reader detects and reports. A writer finding its slot
+	 * still being copied into by a writer of the previous lap drops its record instead of waiting.
+	 *
+	 * Records longer than a slot are truncated.
+	 */
+	class ShmRingSink : public Sink
+	{
+	public:
+		/**
+		 * Create the shared memory segment \p name, or attach to it if it already exists.
+		 *
+		 * An existing segment, e.g. one left behind by a previous run of the service, is used as is,
+		 * so that a reader attached to it does not miss records. It must have the same geometry.
+		 *
+		 * \param name The name of the segment as passed to shm_open, e.g. "/myservice-log".
+		 * \param slotCount The number of records the ring can hold. Must be a power of two.
+		 * \param slotSize The number of bytes per slot, including a 16 byte slot header. Must be a
+		 *                 multiple of 64.
+		 * \throws std::invalid_argument if the geometry is invalid.
+		 * \throws std::system_error if the segment cannot be created or mapped.
+		 * \throws std::runtime_error if the segment exists but is not a ring of this geometry.
+		 */
+		ShmRingSink( const char *name, std::size_t slotCount = 4096, std::size_t slotSize = 512 );
+		ShmRingSink( const ShmRingSink & ) = delete;
+		ShmRingSink &operator=( const ShmRingSink & ) = delete;
+		/**
+		 * Unmaps the segment. The segment itself is only removed if unlinkOnDestroy() was
+		 * requested, so that a reader can still drain it.
+		 */
+		~ShmRingSink();
+
+		void write( const Record &record ) noexcept override;
+
+		/// Remove the segment name from the system when the sink is destroyed.
+		void unlinkOnDestroy( bool unlink ) noexcept
+		{
+			unlink_ = unlink;
+		}
+		/// The number of records that had to be truncated to fit into a slot.
+		std::uint64_t truncated() const noexcept
+		{
+			return truncated_.load( std::memory_order_relaxed );
+		}
+		/**
+		 * The number of records dropped because a writer of the next lap was already done with the
+		 * slot, or because the slot was still or again being copied into by another writer.
+		 */
+		std::uint64_t dropped() const noexcept
+		{
+			return dropped_.load( std::memory_order_relaxed );
+		}
+
+	private:
+		std::string name;
+		shm::Header *header;
+		std::size_t mappedSize;
+		bool unlink_ = false;
+		std::atomic<std::uint64_t> truncated_;
+		std::atomic<std::uint64_t> dropped_;
+	};
+
+	/**
+	 * Reads records from a ring buffer written by a ShmRingSink, possibly in another process.
+	 */
+	class ShmRingReader
+	{
+	public:
+		enum Status
+		{
+			OK,      /**< A record has been read */
+			EMPTY,   /**< No complete record is available (yet) */
+			OVERRUN  /**< Records have been overwritten before they could be read */
+		};
+
+		/**
+		 * Attach read-only to the segment \p name.
+		 *
+		 * \param fromStart Start with the oldest record still in the ring instead of only
+		 *                  reading records written from now on.
+		 * \throws std::system_error if the segment cannot be opened or mapped.
+		 * \throws std::runtime_error if the segment was not created by a ShmRingSink.
+		 */
+		explicit ShmRingReader( const char *name, bool fromStart = true );
+		ShmRingReader( const ShmRingReader & ) = delete;
+		ShmRingReader &operator=( const ShmRingReader & ) = delete;
+		~ShmRingReader();
+
+		/**
+		 * Fetch the next record.
+		 *
+		 * \param[out] record Receives the record text on OK.
+		 * \param[out] level Receives the severity of the record on OK.
+		 * \return OVERRUN if records were lost. The reader has then skipped ahead to the oldest
+		 *         record still available and lost() reports the accumulated number of lost records.
+		 */
+		Status next( std::string &record, LogLevel &level );
+
+		/// The total number of records lost to overruns so far.
+		std::uint64_t lost() const noexcept
+		{
+			return lost_;
+		}
+		/// The sequence number of the next record to be read.
+		std::uint64_t position() const noexcept
+		{
+			return position_;
+		}
+
+	private:
+		const shm::Header *header;
+		std::size_t mappedSize;
+		std::uint64_t position_;
+		std::uint64_t lost_ = 0;
+	};
+}
+
+// vim: ts=4 sw=4 tw=100 noet
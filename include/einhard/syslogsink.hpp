@@ -0,0 +1,119 @@
+/**
+ * @file
+ *
+ * A Sink sending log records to the local syslog daemon or to journald.
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "einhard.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+
+namespace einhard
+{
+	/**
+	 * The syslog severity (RFC 5424, section 6.2.1) corresponding to \p level.
+	 */
+	int syslogSeverity( LogLevel level ) noexcept;
+
+	/**
+	 * A Sink writing records as datagrams to a local Unix domain socket.
+	 *
+	 * Sending never blocks: datagrams the daemon does not accept right away are kept in a bounded
+	 * queue and sent together with the following records using a single sendmmsg call. If the queue
+	 * is full the oldest datagram is dropped.
+	 *
+	 * Color codes as well as the timestamp and severity of the Einhard header are removed from the
+	 * records, as the daemon records these itself. The message starts with the area of the record,
+	 * if it has one, and its continuation lines are not indented. Both are taken from the layout
+	 * the Logger describes in the Record, the records of a Batch following the first one keep their
+	 * headers.
+	 *
+	 * Across fork() datagrams still queued are sent by the parent only.
+	 */
+	class SyslogSink : public Sink, private ForkHandler
+	{
+	public:
+		enum Format
+		{
+			RFC5424, /**< "<PRI>1 TIMESTAMP HOSTNAME APP-NAME PROCID - - MSG", e.g. to /dev/log */
+			JOURNALD /**< The native journald protocol, to /run/systemd/journal/socket */
+		};
+
+		/**
+		 * \param appName Used as APP-NAME or SYSLOG_IDENTIFIER respectively.
+		 * \param format The protocol to speak.
+		 * \param path The socket to send to. A nullptr selects the default socket of \p format.
+		 * \param facility The syslog facility, 1 is "user-level messages".
+		 * \param queueCapacity The number of datagrams kept while the daemon is not accepting any.
+		 *
+		 * Failing to connect is not an error, the sink retries with the following records.
+		 */
+		SyslogSink( const char *appName, Format format = RFC5424, const char *path = nullptr,
+		            int facility = 1, std::size_t queueCapacity = 1024 );
+		SyslogSink( const SyslogSink & ) = delete;
+		SyslogSink &operator=( const SyslogSink & ) = delete;
+		/// Makes a last attempt to send the queued datagrams.
+		~SyslogSink();
+
+		void write( const Record &record ) noexcept override;
+
+		/**
+		 * Try to send all queued datagrams without blocking.
+		 *
+		 * \return Whether the queue is empty now.
+		 */
+		bool flush() noexcept;
+
+		/// The number of datagrams currently waiting to be sent.
+		std::size_t queued() const noexcept;
+		/// The number of records dropped because the queue was full or the daemon rejected them.
+		std::uint64_t dropped() const noexcept
+		{
+			return dropped_.load( std::memory_order_relaxed );
+		}
+
+	private:
+		void format( const Record &record, std::string &datagram ) const;
+		bool connectSocket() noexcept;
+		bool sendQueued() noexcept;
+
+		void prepareFork() noexcept override;
+		void afterForkInParent() noexcept override;
+		void afterForkInChild() noexcept override;
+
+		const std::string appName;
+		const Format format_;
+		const std::string path;
+		const int facility;
+		const std::size_t queueCapacity;
+		std::string hostname;
+
+		mutable std::mutex mutex;
+		int socket_;
+		std::deque<std::string> queue;
+		std::atomic<std::uint64_t> dropped_;
+	};
+}
+
+// vim: ts=4 sw=4 tw=100 noet
@@ -0,0 +1,218 @@
+/**
+ * @file
+ *
+ * Helpers to measure and log the time spent in a scope.
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "einhard.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <type_traits>
+
+namespace einhard
+{
+	/**
+	 * A cheap clock for measuring short intervals.
+	 *
+	 * On x86 CPUs with an invariant time stamp counter this reads the TSC, which is calibrated
+	 * against std::chrono::steady_clock over the first 5 ms after the program has been loaded.
+	 * Everywhere else it falls back to std::chrono::steady_clock. Ticks are only meaningful as
+	 * differences.
+	 */
+	class FastClock
+	{
+	public:
+		typedef std::uint64_t ticks;
+
+		static ticks now() noexcept;
+		static std::uint64_t toNanoseconds( ticks duration ) noexcept;
+		static ticks fromNanoseconds( std::uint64_t nanoseconds ) noexcept;
+		/**
+		 * Complete the calibration now, waiting for the rest of the 5 ms if necessary. Otherwise
+		 * the first conversion does so, which a timed scope in the first milliseconds would add.
+		 */
+		static void calibrate() noexcept;
+		/// Whether the time stamp counter is used.
+		static bool usesTsc() noexcept;
+	};
+
+	/**
+	 * Streams a duration given in nanoseconds with a suitable unit, e.g. "12.5 us".
+	 */
+	struct Duration
+	{
+		std::uint64_t nanoseconds;
+	};
+	std::ostream &operator<<( std::ostream &out, const Duration &duration );
+
+	/**
+	 * Aggregates the durations measured at one place in the code.
+	 *
+	 * Durations are added without locks. Once per period the thread adding a duration takes
+	 * a Summary, which resets the site. As the counters are reset one by one, a summary taken
+	 * while other threads add durations may be slightly inconsistent.
+	 */
+	class TimingSite
+	{
+	public:
+		struct Summary
+		{
+			std::uint64_t count;
+			std::uint64_t min;
+			std::uint64_t max;
+			std::uint64_t average;
+			/// The upper bound of the histogram bucket holding the 99th percentile.
+			std::uint64_t p99;
+		};
+
+		/**
+		 * \param name Identifies the site in the summary.
+		 * \param periodSeconds How often a summary is produced.
+		 */
+		explicit TimingSite( const char *name, double periodSeconds = 10 ) noexcept;
+		TimingSite( const TimingSite & ) = delete;
+		TimingSite &operator=( const TimingSite & ) = delete;
+
+		/**
+		 * Add a duration measured at \p end.
+		 *
+		 * \return true if the period has elapsed and \p summary has been filled.
+		 */
+		bool add( std::uint64_t nanoseconds, FastClock::ticks end, Summary &summary ) noexcept;
+		/// Take a summary of all durations added since the last one and reset the site.
+		Summary takeSummary() noexcept;
+
+		const char *name() const noexcept
+		{
+			return name_;
+		}
+
+	private:
+		static const int BUCKETS = 256;
+		static int bucket( std::uint64_t nanoseconds ) noexcept;
+		static std::uint64_t bucketLimit( int bucket ) noexcept;
+
+		const char *const name_;
+		const FastClock::ticks period;
+		std::atomic<FastClock::ticks> nextSummary;
+		std::atomic<std::uint64_t> count;
+		std::atomic<std::uint64_t> sum;
+		std::atomic<std::uint64_t> min;
+		std::atomic<std::uint64_t> max;
+		std::atomic<std::uint64_t> histogram[BUCKETS];
+	};
+
+	std::ostream &operator<<( std::ostream &out, const TimingSite::Summary &summary );
+
+	/**
+	 * Measures the time until the end of the scope and logs it with \p LEVEL.
+	 *
+	 * If the level is disabled nothing is measured at all. Either every measurement exceeding
+	 * a threshold is logged, or the measurements are aggregated in a TimingSite, which is logged
+	 * once per period.
+	 *
+	 * See EINHARD_TIMED_SCOPE and EINHARD_AGGREGATED_TIMED_SCOPE for convenient use.
+	 */
+	template <LogLevel LEVEL, typename LoggerT> class ScopedTimer
+	{
+	public:
+		/**
+		 * Log "<name> took <duration>" if the duration is at least \p thresholdNanoseconds.
+		 */
+		ScopedTimer( const LoggerT &logger, const char *name, std::uint64_t thresholdNanoseconds = 0 ) noexcept
+		    : logger( logger ), name( name ), site( nullptr ), threshold( thresholdNanoseconds ),
+		      start( logger.template isEnabled<LEVEL>() ? FastClock::now() : 0 )
+		{
+		}
+		/**
+		 * Add the duration to \p site and log the summary of the site once per period.
+		 */
+		ScopedTimer( const LoggerT &logger, TimingSite &site ) noexcept
+		    : logger( logger ), name( site.name() ), site( &site ), threshold( 0 ),
+		      start( logger.template isEnabled<LEVEL>() ? FastClock::now() : 0 )
+		{
+		}
+		ScopedTimer( const ScopedTimer & ) = delete;
+		ScopedTimer &operator=( const ScopedTimer & ) = delete;
+
+		~ScopedTimer()
+		{
+			if( start == 0 )
+			{
+				return;
+			}
+			const FastClock::ticks end = FastClock::now();
+			const std::uint64_t nanoseconds = FastClock::toNanoseconds( end - start );
+			if( site )
+			{
+				TimingSite::Summary summary;
+				if( site->add( nanoseconds, end, summary ) )
+				{
+					logger.template log<LEVEL>() << name << ": " << summary;
+				}
+			}
+			else if( nanoseconds >= threshold )
+			{
+				logger.template log<LEVEL>() << name << " took " << Duration{nanoseconds};
+			}
+		}
+
+		/// The time elapsed since the start of the scope, 0 if the level is disabled.
+		std::uint64_t elapsed() const noexcept
+		{
+			return start == 0 ? 0 : FastClock::toNanoseconds( FastClock::now() - start );
+		}
+
+	private:
+		const LoggerT &logger;
+		const char *const name;
+		TimingSite *const site;
+		const std::uint64_t threshold;
+		const FastClock::ticks start;
+	};
+}
+
+#define EINHARD_CONCAT_IMPL_( a, b ) a##b
+#define EINHARD_CONCAT_( a, b ) EINHARD_CONCAT_IMPL_( a, b )
+
+/**
+ * Log the time spent in the rest of the enclosing scope, e.g.
+ * \code
+ * EINHARD_TIMED_SCOPE( logger, einhard::DEBUG, "parsing" );
+ * \endcode
+ * An optional fourth argument gives the minimum duration in nanoseconds that is logged.
+ */
+#define EINHARD_TIMED_SCOPE( logger, level, ... )                                                                      \
+	::einhard::ScopedTimer<level, typename std::decay<decltype( logger )>::type> EINHARD_CONCAT_(                      \
+	    einhardTimer_, __LINE__ )( logger, __VA_ARGS__ )
+
+/**
+ * Aggregate the time spent in the rest of the enclosing scope and log a min/avg/max/p99 summary
+ * every \p periodSeconds.
+ */
+#define EINHARD_AGGREGATED_TIMED_SCOPE( logger, level, name, periodSeconds )                                           \
+	static ::einhard::TimingSite EINHARD_CONCAT_( einhardTimingSite_, __LINE__ )( name, periodSeconds );             \
+	::einhard::ScopedTimer<level, typename std::decay<decltype( logger )>::type> EINHARD_CONCAT_(                      \
+	    einhardTimer_, __LINE__ )( logger, EINHARD_CONCAT_( einhardTimingSite_, __LINE__ ) )
+
+// vim: ts=4 sw=4 tw=100 noet
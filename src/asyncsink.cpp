@@ -0,0 +1,263 @@
+/**
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <asyncsink.hpp>
+
+#include <algorithm>
+#include <new>
+#include <vector>
+
+namespace einhard
+{
+namespace
+{
+// The maximum number of records the writer takes from a lane at once. Lanes are checked for more
+// severe records in between.
+const std::size_t BATCH_SIZE = 64;
+
+const std::size_t DEFAULT_CAPACITY = 4096;
+}  // unnamed namespace
+
+AsyncSink::AsyncSink( Sink &target_, LogLevel synchronousLevel )
+    : target( target_ ), synchronousLevel_( synchronousLevel ), inFlight( 0 ), stopping( false )
+{
+	for( int level = TRACE; level < OFF; ++level )
+	{
+		Lane &lane = lanes[laneIndex( static_cast<LogLevel>( level ) )];
+		lane.capacity = DEFAULT_CAPACITY;
+		lane.policy = level < WARN ? DROP_OLDEST : BLOCK;
+		lane.stats = LaneStats{0, 0, 0, 0, 0, 0};
+	}
+	writer.reset( new std::thread( &AsyncSink::run, this ) );
+	try
+	{
+		registerForkHandler( this );
+	}
+	catch( ... )
+	{
+		stop();
+		throw;
+	}
+}
+
+AsyncSink::~AsyncSink()
+{
+	unregisterForkHandler( this );
+	stop();
+}
+
+void AsyncSink::stop() noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		stopping = true;
+	}
+	recordsQueued.notify_one();
+	if( writer )
+	{
+		writer->join();
+	}
+}
+
+std::size_t AsyncSink::laneIndex( LogLevel level ) noexcept
+{
+	return level <= TRACE ? 0 : level >= FATAL ? FATAL - TRACE : level - TRACE;
+}
+
+void AsyncSink::write( const Record &record ) noexcept
+{
+	Lane &lane = lanes[laneIndex( record.level )];
+	if( record.level >= synchronousLevel_.load( std::memory_order_relaxed ) )
+	{
+		target.write( record );
+		std::lock_guard<std::mutex> lock( mutex );
+		++lane.stats.bypassed;
+		return;
+	}
+
+	try
+	{
+		Entry entry{record, std::string( record.data, record.size )};
+		std::unique_lock<std::mutex> lock( mutex );
+		if( lane.queue.size() >= lane.capacity )
+		{
+			switch( lane.policy )
+			{
+			case DROP_NEWEST:
+				++lane.stats.dropped;
+				return;
+			case DROP_OLDEST:
+				lane.queue.pop_front();
+				++lane.stats.dropped;
+				break;
+			case BLOCK:
+				++lane.stats.blocked;
+				recordsTaken.wait( lock, [&] { return lane.queue.size() < lane.capacity || stopping; } );
+				break;
+			}
+		}
+		lane.queue.push_back( std::move( entry ) );
+		lane.stats.peakDepth = std::max( lane.stats.peakDepth, lane.queue.size() );
+	}
+	catch( std::bad_alloc & )
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		++lane.stats.dropped;
+		return;
+	}
+	recordsQueued.notify_one();
+}
+
+void AsyncSink::configureLane( LogLevel level, std::size_t capacity, DropPolicy policy )
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		Lane &lane = lanes[laneIndex( level )];
+		lane.capacity = std::max<std::size_t>( capacity, 1 );
+		lane.policy = policy;
+	}
+	// blocked threads might fit into the new capacity
+	recordsTaken.notify_all();
+}
+
+void AsyncSink::setSynchronousLevel( LogLevel level ) noexcept
+{
+	synchronousLevel_.store( level, std::memory_order_relaxed );
+}
+
+LogLevel AsyncSink::synchronousLevel() const noexcept
+{
+	return static_cast<LogLevel>( synchronousLevel_.load( std::memory_order_relaxed ) );
+}
+
+void AsyncSink::flush()
+{
+	std::unique_lock<std::mutex> lock( mutex );
+	recordsTaken.wait( lock, [this] {
+		return inFlight == 0 && std::all_of( std::begin( lanes ), std::end( lanes ),
+		                                     []( const Lane &lane ) { return lane.queue.empty(); } );
+	} );
+}
+
+AsyncSink::LaneStats AsyncSink::stats( LogLevel level ) const
+{
+	std::lock_guard<std::mutex> lock( mutex );
+	const Lane &lane = lanes[laneIndex( level )];
+	LaneStats stats = lane.stats;
+	stats.depth = lane.queue.size();
+	return stats;
+}
+
+std::size_t AsyncSink::depth() const
+{
+	std::lock_guard<std::mutex> lock( mutex );
+	std::size_t depth = inFlight;
+	for( const Lane &lane : lanes )
+	{
+		depth += lane.queue.size();
+	}
+	return depth;
+}
+
+void AsyncSink::prepareFork() noexcept
+{
+	// Queued records stay with the parent, but a batch being written would be lost
+	std::unique_lock<std::mutex> lock( mutex );
+	recordsTaken.wait( lock, [this] { return inFlight == 0; } );
+	lock.release();
+}
+
+void AsyncSink::afterForkInParent() noexcept
+{
+	mutex.unlock();
+}
+
+void AsyncSink::afterForkInChild() noexcept
+{
+	// The writer thread does not exist in the child, joining or destroying it is not possible
+	writer.release();
+	for( Lane &lane : lanes )
+	{
+		lane.queue.clear();
+		lane.stats = LaneStats{0, 0, 0, 0, 0, 0};
+	}
+	// Neither do the threads that might have been waiting for these
+	new( &recordsQueued ) std::condition_variable;
+	new( &recordsTaken ) std::condition_variable;
+	mutex.unlock();
+	try
+	{
+		writer.reset( new std::thread( &AsyncSink::run, this ) );
+	}
+	catch( ... )
+	{
+		// Without a writer thread all records must bypass the lanes
+		synchronousLevel_.store( ALL, std::memory_order_relaxed );
+	}
+}
+
+void AsyncSink::run()
+{
+	std::vector<Entry> batch;
+	batch.reserve( BATCH_SIZE );
+	std::unique_lock<std::mutex> lock( mutex );
+	for( ;; )
+	{
+		// the most severe lane holding records
+		Lane *lane = nullptr;
+		for( Lane *it = std::end( lanes ); it != std::begin( lanes ); )
+		{
+			if( !( --it )->queue.empty() )
+			{
+				lane = it;
+				break;
+			}
+		}
+		if( !lane )
+		{
+			if( stopping )
+			{
+				return;
+			}
+			recordsQueued.wait( lock );
+			continue;
+		}
+
+		const std::size_t count = std::min( lane->queue.size(), BATCH_SIZE );
+		std::move( lane->queue.begin(), lane->queue.begin() + count, std::back_inserter( batch ) );
+		lane->queue.erase( lane->queue.begin(), lane->queue.begin() + count );
+		inFlight = count;
+		lock.unlock();
+		recordsTaken.notify_all();
+
+		for( const Entry &entry : batch )
+		{
+			Record record = entry.record;
+			record.data = entry.data.data();
+			target.write( record );
+		}
+		batch.clear();
+
+		lock.lock();
+		lane->stats.written += count;
+		inFlight = 0;
+		recordsTaken.notify_all();
+	}
+}
+}  // namespace einhard
+
+// vim: ts=4 sw=4 tw=100 noet
@@ -0,0 +1,151 @@
+/**
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <filesink.hpp>
+
+#include <cerrno>
+#include <new>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace einhard
+{
+FileSink::FileSink( const std::string &pathPattern, bool stripColor_, mode_t mode_ )
+    : pattern( pathPattern ), stripColor( stripColor_ ), mode( mode_ ), path_( expand( pathPattern ) ),
+      fd( open( path_ ) )
+{
+	if( fd < 0 )
+	{
+		throw std::system_error( errno, std::generic_category(), "open " + path_ );
+	}
+	try
+	{
+		registerForkHandler( this );
+	}
+	catch( ... )
+	{
+		close( fd );
+		throw;
+	}
+}
+
+FileSink::~FileSink()
+{
+	unregisterForkHandler( this );
+	close( fd );
+}
+
+std::string FileSink::expand( const std::string &pattern )
+{
+	const std::string pid = std::to_string( getpid() );
+	std::string path;
+	for( std::string::size_type i = 0; i < pattern.size(); ++i )
+	{
+		if( pattern[i] == '%' && i + 1 < pattern.size() && pattern[i + 1] == 'p' )
+		{
+			path += pid;
+			++i;
+		}
+		else
+		{
+			path += pattern[i];
+		}
+	}
+	return path;
+}
+
+int FileSink::open( const std::string &path ) const noexcept
+{
+	int result;
+	do
+	{
+		result = ::open( path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, mode );
+	} while( result < 0 && errno == EINTR );
+	return result;
+}
+
+void FileSink::write( const Record &record ) noexcept
+{
+	const char *data = record.data;
+	std::size_t size = record.size;
+	std::string plain;
+	if( stripColor && record.colored )
+	{
+		try
+		{
+			record.withoutColor( plain );
+		}
+		catch( std::bad_alloc & )
+		{
+			return;
+		}
+		data = plain.data();
+		size = plain.size();
+	}
+	// Regular files take the whole record at once, the loop only covers signals and full disks
+	while( size > 0 )
+	{
+		const ssize_t written = ::write( fd, data, size );
+		if( written < 0 )
+		{
+			if( errno == EINTR )
+			{
+				continue;
+			}
+			return;
+		}
+		data += written;
+		size -= written;
+	}
+}
+
+void FileSink::prepareFork() noexcept
+{
+}
+
+void FileSink::afterForkInParent() noexcept
+{
+}
+
+void FileSink::afterForkInChild() noexcept
+{
+	if( pattern.find( "%p" ) == std::string::npos )
+	{
+		return;
+	}
+	try
+	{
+		std::string childPath = expand( pattern );
+		const int childFd = open( childPath );
+		if( childFd < 0 )
+		{
+			// Rather write to the file of the parent than lose the records
+			return;
+		}
+		close( fd );
+		fd = childFd;
+		path_.swap( childPath );
+	}
+	catch( std::bad_alloc & )
+	{
+	}
+}
+}  // namespace einhard
+
+// vim: ts=4 sw=4 tw=100 noet
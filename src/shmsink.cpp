@@ -0,0 +1,320 @@
+/**
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <shmsink.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace einhard
+{
+namespace shm
+{
+// "EINHRING" in ASCII
+const std::uint64_t MAGIC = 0x45494e4852494e47ull;
+const std::uint32_t FORMAT_VERSION = 2;
+// Set in the seq of a slot completed without a record
+const std::uint64_t DROPPED = 1ull << 63;
+
+/*
+ * Layout of the segment: the Header, followed by slotCount slots of slotSize bytes each.
+ *
+ * Slot i holds the record with sequence number n where n % slotCount == i. While the record n is
+ * being copied the slot's seq is 2n+1, once it is complete seq is 2n+2. A slot never written
+ * has seq 0.
+ *
+ * A writer of a later lap finding the slot still being copied, or left odd by a writer that died,
+ * drops its record without waiting and completes the slot itself as 2n+2 | DROPPED, which readers
+ * skip. The writer copying then finds its seq taken over and drops its record, too. Should it
+ * still be copying when a writer of yet another lap claims the slot, that record may be garbled.
+ */
+struct Header
+{
+	std::atomic<std::uint64_t> magic;
+	std::uint32_t version;
+	std::uint32_t slotSize;
+	std::uint64_t slotCount;
+	// next sequence number to be claimed by a writer, on its own cache line
+	alignas( 64 ) std::atomic<std::uint64_t> head;
+};
+
+struct Slot
+{
+	std::atomic<std::uint64_t> seq;
+	std::uint32_t size;
+	std::uint32_t level;
+	// followed by slotSize - sizeof( Slot ) bytes of record data
+};
+
+static_assert( sizeof( Header ) == 128, "the shared memory layout must not depend on the compiler" );
+static_assert( sizeof( Slot ) == 16, "the shared memory layout must not depend on the compiler" );
+
+namespace
+{
+inline Slot &slotAt( const Header *header, std::uint64_t n ) noexcept
+{
+	char *base = reinterpret_cast<char *>( const_cast<Header *>( header ) ) + sizeof( Header );
+	return *reinterpret_cast<Slot *>( base + ( n & ( header->slotCount - 1 ) ) * header->slotSize );
+}
+
+inline char *slotData( Slot &slot ) noexcept
+{
+	return reinterpret_cast<char *>( &slot ) + sizeof( Slot );
+}
+}  // unnamed namespace
+}  // namespace shm
+
+ShmRingSink::ShmRingSink( const char *name_, std::size_t slotCount, std::size_t slotSize )
+    : name( name_ ), header( nullptr ), mappedSize( 0 ), truncated_( 0 ), dropped_( 0 )
+{
+	if( slotCount == 0 || ( slotCount & ( slotCount - 1 ) ) != 0 )
+	{
+		throw std::invalid_argument( "ShmRingSink: the slot count must be a power of two" );
+	}
+	if( slotSize < 64 || slotSize % 64 != 0 || slotSize > UINT32_MAX )
+	{
+		throw std::invalid_argument( "ShmRingSink: the slot size must be a multiple of 64" );
+	}
+
+	mappedSize = sizeof( shm::Header ) + slotCount * slotSize;
+	// Only the process creating the segment sizes and initializes it. Others, e.g. the same
+	// service restarted, attach to it, as a reader may have mapped it.
+	bool created = true;
+	int fd = shm_open( name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644 );
+	if( fd < 0 && errno == EEXIST )
+	{
+		created = false;
+		fd = shm_open( name.c_str(), O_RDWR | O_CLOEXEC, 0 );
+	}
+	if( fd < 0 )
+	{
+		throw std::system_error( errno, std::generic_category(), "shm_open " + name );
+	}
+	struct stat st;
+	if( !created && ( fstat( fd, &st ) != 0 || static_cast<std::size_t>( st.st_size ) != mappedSize ) )
+	{
+		close( fd );
+		throw std::runtime_error( "ShmRingSink: " + name + " exists with another size" );
+	}
+	if( created && ftruncate( fd, mappedSize ) != 0 )
+	{
+		const int error = errno;
+		close( fd );
+		shm_unlink( name.c_str() );
+		throw std::system_error( error, std::generic_category(), "ftruncate " + name );
+	}
+	void *mem = mmap( nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	const int error = errno;
+	close( fd );
+	if( mem == MAP_FAILED )
+	{
+		throw std::system_error( error, std::generic_category(), "mmap " + name );
+	}
+	header = static_cast<shm::Header *>( mem );
+
+	if( !created )
+	{
+		if( header->magic.load( std::memory_order_acquire ) != shm::MAGIC ||
+		    header->version != shm::FORMAT_VERSION || header->slotSize != slotSize ||
+		    header->slotCount != slotCount )
+		{
+			munmap( mem, mappedSize );
+			throw std::runtime_error( "ShmRingSink: " + name + " is not a ring buffer of this geometry" );
+		}
+		return;
+	}
+
+	// Readers only accept the segment once the magic has been published
+	header->version = shm::FORMAT_VERSION;
+	header->slotSize = static_cast<std::uint32_t>( slotSize );
+	header->slotCount = slotCount;
+	header->head.store( 0, std::memory_order_relaxed );
+	for( std::uint64_t i = 0; i < slotCount; ++i )
+	{
+		shm::slotAt( header, i ).seq.store( 0, std::memory_order_relaxed );
+	}
+	header->magic.store( shm::MAGIC, std::memory_order_release );
+}
+
+ShmRingSink::~ShmRingSink()
+{
+	munmap( header, mappedSize );
+	if( unlink_ )
+	{
+		shm_unlink( name.c_str() );
+	}
+}
+
+void ShmRingSink::write( const Record &record ) noexcept
+{
+	const std::uint64_t n = header->head.fetch_add( 1, std::memory_order_relaxed );
+	shm::Slot &slot = shm::slotAt( header, n );
+
+	// Claim the slot. If a writer of a previous lap is still copying, or one of the next lap
+	// already overtook us, the record is dropped. Never waits for another writer.
+	std::uint64_t seq = slot.seq.load( std::memory_order_relaxed );
+	for( ;; )
+	{
+		if( ( seq & ~shm::DROPPED ) > 2 * n )
+		{
+			dropped_.fetch_add( 1, std::memory_order_relaxed );
+			return;
+		}
+		if( seq & 1 )
+		{
+			// complete the slot without a record, the writer copying may never do so
+			if( slot.seq.compare_exchange_weak( seq, ( 2 * n + 2 ) | shm::DROPPED, std::memory_order_release,
+			                                    std::memory_order_relaxed ) )
+			{
+				dropped_.fetch_add( 1, std::memory_order_relaxed );
+				return;
+			}
+			continue;
+		}
+		if( slot.seq.compare_exchange_weak( seq, 2 * n + 1, std::memory_order_relaxed ) )
+		{
+			break;
+		}
+	}
+	std::atomic_thread_fence( std::memory_order_release );
+
+	const std::size_t capacity = header->slotSize - sizeof( shm::Slot );
+	std::size_t size = record.size;
+	char *data = shm::slotData( slot );
+	if( size > capacity )
+	{
+		size = capacity;
+		std::memcpy( data, record.data, size - 1 );
+		data[size - 1] = '\n';
+		truncated_.fetch_add( 1, std::memory_order_relaxed );
+	}
+	else
+	{
+		std::memcpy( data, record.data, size );
+	}
+	slot.size = static_cast<std::uint32_t>( size );
+	slot.level = record.level;
+
+	std::uint64_t claimed = 2 * n + 1;
+	if( !slot.seq.compare_exchange_strong( claimed, 2 * n + 2, std::memory_order_release,
+	                                       std::memory_order_relaxed ) )
+	{
+		// taken over while copying, the slot has been completed without this record
+		dropped_.fetch_add( 1, std::memory_order_relaxed );
+	}
+}
+
+ShmRingReader::ShmRingReader( const char *name, bool fromStart ) : header( nullptr ), mappedSize( 0 )
+{
+	const int fd = shm_open( name, O_RDONLY | O_CLOEXEC, 0 );
+	if( fd < 0 )
+	{
+		throw std::system_error( errno, std::generic_category(), std::string( "shm_open " ) + name );
+	}
+	struct stat st;
+	if( fstat( fd, &st ) != 0 || static_cast<std::size_t>( st.st_size ) < sizeof( shm::Header ) )
+	{
+		close( fd );
+		throw std::runtime_error( std::string( name ) + " is not an Einhard ring buffer" );
+	}
+	mappedSize = st.st_size;
+	void *mem = mmap( nullptr, mappedSize, PROT_READ, MAP_SHARED, fd, 0 );
+	const int error = errno;
+	close( fd );
+	if( mem == MAP_FAILED )
+	{
+		throw std::system_error( error, std::generic_category(), std::string( "mmap " ) + name );
+	}
+	header = static_cast<const shm::Header *>( mem );
+
+	if( header->magic.load( std::memory_order_acquire ) != shm::MAGIC ||
+	    header->version != shm::FORMAT_VERSION ||
+	    mappedSize < sizeof( shm::Header ) + header->slotCount * header->slotSize )
+	{
+		munmap( const_cast<shm::Header *>( header ), mappedSize );
+		throw std::runtime_error( std::string( name ) + " is not an Einhard ring buffer" );
+	}
+
+	const std::uint64_t head = header->head.load( std::memory_order_acquire );
+	if( fromStart )
+	{
+		position_ = head > header->slotCount ? head - header->slotCount : 0;
+	}
+	else
+	{
+		position_ = head;
+	}
+}
+
+ShmRingReader::~ShmRingReader()
+{
+	munmap( const_cast<shm::Header *>( header ), mappedSize );
+}
+
+ShmRingReader::Status ShmRingReader::next( std::string &record, LogLevel &level )
+{
+	const std::uint64_t slotCount = header->slotCount;
+	const std::uint64_t head = header->head.load( std::memory_order_acquire );
+	if( position_ >= head )
+	{
+		return EMPTY;
+	}
+	if( head - position_ > slotCount )
+	{
+		lost_ += head - slotCount - position_;
+		position_ = head - slotCount;
+		return OVERRUN;
+	}
+
+	shm::Slot &slot = shm::slotAt( header, position_ );
+	const std::uint64_t expected = 2 * position_ + 2;
+	const std::uint64_t seq = slot.seq.load( std::memory_order_acquire );
+	if( ( seq & ~shm::DROPPED ) < expected )
+	{
+		// the writer has claimed the sequence number but not yet completed the record
+		return EMPTY;
+	}
+	if( seq == expected )
+	{
+		const std::size_t capacity = header->slotSize - sizeof( shm::Slot );
+		const std::size_t size = std::min<std::size_t>( slot.size, capacity );
+		const LogLevel recordLevel = static_cast<LogLevel>( slot.level );
+		record.assign( shm::slotData( slot ), size );
+		std::atomic_thread_fence( std::memory_order_acquire );
+		if( slot.seq.load( std::memory_order_relaxed ) == expected )
+		{
+			level = recordLevel;
+			++position_;
+			return OK;
+		}
+	}
+
+	// The record was overwritten (or dropped by its writer) before we could read it.
+	++lost_;
+	++position_;
+	return OVERRUN;
+}
+}  // namespace einhard
+
+// vim: ts=4 sw=4 tw=100 noet
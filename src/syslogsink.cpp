@@ -0,0 +1,352 @@
+/**
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <syslogsink.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <new>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace einhard
+{
+namespace
+{
+// The maximum number of datagrams passed to a single sendmmsg call
+const std::size_t BATCH_SIZE = 64;
+
+void appendLittleEndian64( std::string &out, std::uint64_t value )
+{
+	for( int i = 0; i < 8; ++i )
+	{
+		out.push_back( static_cast<char>( value >> ( 8 * i ) ) );
+	}
+}
+
+/*
+ * The UTC calendar date and time of t, without the lock gmtime_r takes, which a fork() could leave
+ * locked in the child. Days to civil date as in Howard Hinnant's chrono-compatible algorithms.
+ */
+void utcTime( std::time_t t, tm &utc ) noexcept
+{
+	std::int64_t days = t / 86400;
+	std::int64_t seconds = t % 86400;
+	if( seconds < 0 )
+	{
+		seconds += 86400;
+		--days;
+	}
+	utc.tm_hour = static_cast<int>( seconds / 3600 );
+	utc.tm_min = static_cast<int>( seconds / 60 % 60 );
+	utc.tm_sec = static_cast<int>( seconds % 60 );
+
+	days += 719468;
+	const std::int64_t era = ( days >= 0 ? days : days - 146096 ) / 146097;
+	const std::int64_t dayOfEra = days - era * 146097;
+	const std::int64_t yearOfEra = ( dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096 ) / 365;
+	const std::int64_t dayOfYear = dayOfEra - ( 365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100 );
+	const std::int64_t monthIndex = ( 5 * dayOfYear + 2 ) / 153;  // March is 0
+	utc.tm_mday = static_cast<int>( dayOfYear - ( 153 * monthIndex + 2 ) / 5 + 1 );
+	utc.tm_mon = static_cast<int>( monthIndex < 10 ? monthIndex + 2 : monthIndex - 10 );
+	utc.tm_year = static_cast<int>( yearOfEra + era * 400 + ( utc.tm_mon <= 1 ) - 1900 );
+}
+/*
+ * The message of a record without color codes: without the time and level of the header but with
+ * its area, continuation lines without the indent aligning them with the first line and without
+ * the final newline.
+ */
+std::string messageOf( const Record &record )
+{
+	std::string message;
+	const std::size_t begin = std::min( record.message, record.size );
+	if( record.areaSize > 0 && record.area + record.areaSize <= begin )
+	{
+		message.assign( record.data + record.area, record.areaSize );
+		message += ": ";
+	}
+	std::string plain;
+	Record{record.level, record.data + begin, record.size - begin, record.colored, 0, 0, 0, 0}.withoutColor( plain );
+
+	const std::size_t indent = begin > 0 ? record.indent : 0;
+	const std::size_t firstLineEnd = std::min( plain.find( '\n' ), plain.size() );
+	message.append( plain, 0, firstLineEnd );
+	for( std::size_t line = firstLineEnd + 1; line < plain.size(); )
+	{
+		const std::size_t lineEnd = std::min( plain.find( '\n', line ), plain.size() );
+		std::size_t text = line;
+		while( text < lineEnd && text - line < indent && plain[text] == ' ' )
+		{
+			++text;
+		}
+		message += '\n';
+		message.append( plain, text, lineEnd - text );
+		line = lineEnd + 1;
+	}
+	while( !message.empty() && message.back() == '\n' )
+	{
+		message.pop_back();
+	}
+	return message;
+}
+}  // unnamed namespace
+
+int syslogSeverity( LogLevel level ) noexcept
+{
+	switch( level )
+	{
+	case ALL:
+	case TRACE:
+	case DEBUG:
+		return 7;  // debug
+	case INFO:
+		return 6;  // informational
+	case WARN:
+		return 4;  // warning
+	case ERROR:
+		return 3;  // error
+	case FATAL:
+	case OFF:
+		return 2;  // critical
+	}
+	return 7;
+}
+
+SyslogSink::SyslogSink( const char *appName_, Format format, const char *path_, int facility_,
+                        std::size_t queueCapacity_ )
+    : appName( appName_ ), format_( format ),
+      path( path_ ? path_ : ( format == JOURNALD ? "/run/systemd/journal/socket" : "/dev/log" ) ),
+      facility( facility_ ), queueCapacity( std::max<std::size_t>( queueCapacity_, 1 ) ),
+      socket_( -1 ), dropped_( 0 )
+{
+	char name[256];
+	if( gethostname( name, sizeof( name ) ) == 0 )
+	{
+		name[sizeof( name ) - 1] = '\0';
+		hostname = name;
+	}
+	else
+	{
+		hostname = "-";
+	}
+	connectSocket();
+	registerForkHandler( this );
+}
+
+SyslogSink::~SyslogSink()
+{
+	unregisterForkHandler( this );
+	flush();
+	if( socket_ >= 0 )
+	{
+		close( socket_ );
+	}
+}
+
+bool SyslogSink::connectSocket() noexcept
+{
+	sockaddr_un address;
+	if( path.size() >= sizeof( address.sun_path ) )
+	{
+		return false;
+	}
+	std::memset( &address, 0, sizeof( address ) );
+	address.sun_family = AF_UNIX;
+	std::memcpy( address.sun_path, path.c_str(), path.size() + 1 );
+
+	const int fd = socket( AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+	if( fd < 0 )
+	{
+		return false;
+	}
+	if( connect( fd, reinterpret_cast<sockaddr *>( &address ), sizeof( address ) ) != 0 )
+	{
+		close( fd );
+		return false;
+	}
+	socket_ = fd;
+	return true;
+}
+
+void SyslogSink::format( const Record &record, std::string &datagram ) const
+{
+	const std::string message = messageOf( record );
+	const int severity = syslogSeverity( record.level );
+
+	char buffer[128];
+	if( format_ == RFC5424 )
+	{
+		timespec now;
+		clock_gettime( CLOCK_REALTIME, &now );
+		tm utc;
+		utcTime( now.tv_sec, utc );
+		std::snprintf( buffer, sizeof( buffer ), "<%d>1 %04d-%02d-%02dT%02d:%02d:%02d.%06ldZ ",
+		               facility * 8 + severity, utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday,
+		               utc.tm_hour, utc.tm_min, utc.tm_sec, now.tv_nsec / 1000 );
+		datagram.reserve( message.size() + 128 );
+		datagram = buffer;
+		datagram += hostname;
+		datagram += ' ';
+		datagram += appName;
+		std::snprintf( buffer, sizeof( buffer ), " %ld - - ", static_cast<long>( getpid() ) );
+		datagram += buffer;
+		datagram += message;
+	}
+	else
+	{
+		std::snprintf( buffer, sizeof( buffer ), "PRIORITY=%d\nSYSLOG_FACILITY=%d\nSYSLOG_PID=%ld\n",
+		               severity, facility, static_cast<long>( getpid() ) );
+		datagram.reserve( message.size() + 128 );
+		datagram = buffer;
+		datagram += "SYSLOG_IDENTIFIER=";
+		datagram += appName;
+		datagram += '\n';
+		if( message.find( '\n' ) == std::string::npos )
+		{
+			datagram += "MESSAGE=";
+		}
+		else
+		{
+			// multi-line values must be sent length-prefixed
+			datagram += "MESSAGE\n";
+			appendLittleEndian64( datagram, message.size() );
+		}
+		datagram += message;
+		datagram += '\n';
+	}
+}
+
+void SyslogSink::write( const Record &record ) noexcept
+{
+	try
+	{
+		std::string datagram;
+		format( record, datagram );
+
+		std::lock_guard<std::mutex> lock( mutex );
+		if( queue.size() >= queueCapacity )
+		{
+			queue.pop_front();
+			dropped_.fetch_add( 1, std::memory_order_relaxed );
+		}
+		queue.push_back( std::move( datagram ) );
+		sendQueued();
+	}
+	catch( std::bad_alloc & )
+	{
+		dropped_.fetch_add( 1, std::memory_order_relaxed );
+	}
+}
+
+bool SyslogSink::flush() noexcept
+{
+	std::lock_guard<std::mutex> lock( mutex );
+	return sendQueued();
+}
+
+std::size_t SyslogSink::queued() const noexcept
+{
+	std::lock_guard<std::mutex> lock( mutex );
+	return queue.size();
+}
+
+void SyslogSink::prepareFork() noexcept
+{
+	mutex.lock();
+	sendQueued();
+}
+
+void SyslogSink::afterForkInParent() noexcept
+{
+	mutex.unlock();
+}
+
+void SyslogSink::afterForkInChild() noexcept
+{
+	// The parent sends what is left, the child would duplicate it
+	queue.clear();
+	mutex.unlock();
+}
+
+bool SyslogSink::sendQueued() noexcept
+{
+	bool reconnected = false;
+	while( !queue.empty() )
+	{
+		if( socket_ < 0 )
+		{
+			if( reconnected || !connectSocket() )
+			{
+				return false;
+			}
+			reconnected = true;
+		}
+
+		mmsghdr messages[BATCH_SIZE];
+		iovec vectors[BATCH_SIZE];
+		const std::size_t count = std::min( queue.size(), BATCH_SIZE );
+		std::memset( messages, 0, sizeof( messages[0] ) * count );
+		for( std::size_t i = 0; i < count; ++i )
+		{
+			vectors[i].iov_base = const_cast<char *>( queue[i].data() );
+			vectors[i].iov_len = queue[i].size();
+			messages[i].msg_hdr.msg_iov = &vectors[i];
+			messages[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		const int sent = sendmmsg( socket_, messages, count, MSG_DONTWAIT | MSG_NOSIGNAL );
+		if( sent > 0 )
+		{
+			queue.erase( queue.begin(), queue.begin() + sent );
+			continue;
+		}
+		if( sent == 0 )
+		{
+			// nothing sent but no error either, errno is stale: retry with the next attempt
+			return false;
+		}
+		switch( errno )
+		{
+		case EINTR:
+			break;
+		case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+		case EWOULDBLOCK:
+#endif
+		case ENOBUFS:
+			// the daemon is busy, keep the datagrams for the next attempt
+			return false;
+		case EMSGSIZE:
+			queue.pop_front();
+			dropped_.fetch_add( 1, std::memory_order_relaxed );
+			break;
+		default:
+			// e.g. the daemon has been restarted, try once to reconnect
+			close( socket_ );
+			socket_ = -1;
+			break;
+		}
+	}
+	return true;
+}
+}  // namespace einhard
+
+// vim: ts=4 sw=4 tw=100 noet
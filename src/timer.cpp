@@ -0,0 +1,295 @@
+/**
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <timer.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <cpuid.h>
+#include <x86intrin.h>
+#define EINHARD_HAVE_TSC 1
+#endif
+
+namespace einhard
+{
+namespace
+{
+typedef std::chrono::steady_clock SteadyClock;
+
+std::uint64_t steadyNanoseconds() noexcept
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>( SteadyClock::now().time_since_epoch() )
+	    .count();
+}
+
+#ifdef EINHARD_HAVE_TSC
+// Only a TSC ticking at a constant rate in all power states can be used as a clock
+bool detectInvariantTsc() noexcept
+{
+	unsigned int eax, ebx, ecx, edx;
+	if( !__get_cpuid( 0x80000000, &eax, &ebx, &ecx, &edx ) || eax < 0x80000007 )
+	{
+		return false;
+	}
+	__get_cpuid( 0x80000007, &eax, &ebx, &ecx, &edx );
+	return ( edx & ( 1u << 8 ) ) != 0;
+}
+
+// A function local static, as timers might be used during static initialization
+bool useTsc() noexcept
+{
+	static const bool invariantTsc = detectInvariantTsc();
+	return invariantTsc;
+}
+
+// The readings of both clocks the calibration starts from
+struct CalibrationStart
+{
+	std::uint64_t steady;
+	std::uint64_t tsc;
+};
+
+const CalibrationStart &calibrationStart() noexcept
+{
+	static const CalibrationStart start = {steadyNanoseconds(), __rdtsc()};
+	return start;
+}
+
+// Measures the TSC frequency against the steady clock over at least 5 ms since the start, which
+// usually have long passed when the first duration is converted
+double calibrateTicksPerNanosecond() noexcept
+{
+	const CalibrationStart &start = calibrationStart();
+	std::uint64_t steadyEnd;
+	do
+	{
+		steadyEnd = steadyNanoseconds();
+	} while( steadyEnd - start.steady < 5000000 );
+	const std::uint64_t tscEnd = __rdtsc();
+	return static_cast<double>( tscEnd - start.tsc ) / static_cast<double>( steadyEnd - start.steady );
+}
+
+double ticksPerNanosecond() noexcept
+{
+	static const double ratio = calibrateTicksPerNanosecond();
+	return ratio;
+}
+
+// Starts the calibration when the program is loaded rather than in the first timed scope
+struct CalibrationAtLoad
+{
+	CalibrationAtLoad() noexcept
+	{
+		if( useTsc() )
+		{
+			calibrationStart();
+		}
+	}
+} calibrationAtLoad;
+#endif
+}  // unnamed namespace
+
+FastClock::ticks FastClock::now() noexcept
+{
+#ifdef EINHARD_HAVE_TSC
+	if( useTsc() )
+	{
+		// never return 0, ScopedTimer uses it to mark a disabled timer
+		return __rdtsc() | 1;
+	}
+#endif
+	return steadyNanoseconds() | 1;
+}
+
+std::uint64_t FastClock::toNanoseconds( ticks duration ) noexcept
+{
+#ifdef EINHARD_HAVE_TSC
+	if( useTsc() )
+	{
+		return static_cast<std::uint64_t>( duration / ticksPerNanosecond() );
+	}
+#endif
+	return duration;
+}
+
+FastClock::ticks FastClock::fromNanoseconds( std::uint64_t nanoseconds ) noexcept
+{
+#ifdef EINHARD_HAVE_TSC
+	if( useTsc() )
+	{
+		return static_cast<ticks>( nanoseconds * ticksPerNanosecond() );
+	}
+#endif
+	return nanoseconds;
+}
+
+void FastClock::calibrate() noexcept
+{
+#ifdef EINHARD_HAVE_TSC
+	if( useTsc() )
+	{
+		ticksPerNanosecond();
+	}
+#endif
+}
+
+bool FastClock::usesTsc() noexcept
+{
+#ifdef EINHARD_HAVE_TSC
+	return useTsc();
+#else
+	return false;
+#endif
+}
+
+std::ostream &operator<<( std::ostream &out, const Duration &duration )
+{
+	static const char *const UNITS[] = {"ns", "us", "ms", "s"};
+	char buffer[32];
+	if( duration.nanoseconds < 1000 )
+	{
+		std::snprintf( buffer, sizeof( buffer ), "%u ns", static_cast<unsigned>( duration.nanoseconds ) );
+	}
+	else
+	{
+		double value = static_cast<double>( duration.nanoseconds );
+		int unit = 0;
+		// values rounding up to 1000 belong to the next unit, %.3g would print them as "1e+03"
+		while( value >= 999.5 && unit < 3 )
+		{
+			value /= 1000;
+			++unit;
+		}
+		std::snprintf( buffer, sizeof( buffer ), value >= 999.5 ? "%.0f %s" : "%.3g %s", value, UNITS[unit] );
+	}
+	return out << buffer;
+}
+
+// Durations below 16 ns get a bucket each, above that every power of two is split into four
+// buckets, which limits the error of the percentile to 25%.
+int TimingSite::bucket( std::uint64_t nanoseconds ) noexcept
+{
+	if( nanoseconds < 16 )
+	{
+		return static_cast<int>( nanoseconds );
+	}
+	const int exponent = 63 - __builtin_clzll( nanoseconds );
+	const int fraction = static_cast<int>( nanoseconds >> ( exponent - 2 ) ) & 3;
+	return 16 + ( exponent - 4 ) * 4 + fraction;
+}
+
+std::uint64_t TimingSite::bucketLimit( int bucket ) noexcept
+{
+	if( bucket < 16 )
+	{
+		return static_cast<std::uint64_t>( bucket );
+	}
+	const int exponent = ( bucket - 16 ) / 4 + 4;
+	const std::uint64_t fraction = ( bucket - 16 ) % 4;
+	if( exponent == 63 && fraction == 3 )
+	{
+		return std::numeric_limits<std::uint64_t>::max();
+	}
+	return ( ( 5 + fraction ) << ( exponent - 2 ) ) - 1;
+}
+
+TimingSite::TimingSite( const char *name, double periodSeconds ) noexcept
+    : name_( name ),
+      period( FastClock::fromNanoseconds( static_cast<std::uint64_t>( periodSeconds * 1e9 ) ) ),
+      nextSummary( FastClock::now() + period ), count( 0 ), sum( 0 ),
+      min( std::numeric_limits<std::uint64_t>::max() ), max( 0 )
+{
+	for( int i = 0; i < BUCKETS; ++i )
+	{
+		histogram[i].store( 0, std::memory_order_relaxed );
+	}
+}
+
+bool TimingSite::add( std::uint64_t nanoseconds, FastClock::ticks end, Summary &summary ) noexcept
+{
+	count.fetch_add( 1, std::memory_order_relaxed );
+	sum.fetch_add( nanoseconds, std::memory_order_relaxed );
+	histogram[bucket( nanoseconds )].fetch_add( 1, std::memory_order_relaxed );
+	std::uint64_t current = min.load( std::memory_order_relaxed );
+	while( nanoseconds < current &&
+	       !min.compare_exchange_weak( current, nanoseconds, std::memory_order_relaxed ) )
+	{
+	}
+	current = max.load( std::memory_order_relaxed );
+	while( nanoseconds > current &&
+	       !max.compare_exchange_weak( current, nanoseconds, std::memory_order_relaxed ) )
+	{
+	}
+
+	FastClock::ticks due = nextSummary.load( std::memory_order_relaxed );
+	if( end < due ||
+	    !nextSummary.compare_exchange_strong( due, end + period, std::memory_order_relaxed ) )
+	{
+		return false;
+	}
+	summary = takeSummary();
+	return true;
+}
+
+TimingSite::Summary TimingSite::takeSummary() noexcept
+{
+	Summary summary;
+	summary.count = count.exchange( 0, std::memory_order_relaxed );
+	const std::uint64_t total = sum.exchange( 0, std::memory_order_relaxed );
+	summary.min = min.exchange( std::numeric_limits<std::uint64_t>::max(), std::memory_order_relaxed );
+	summary.max = max.exchange( 0, std::memory_order_relaxed );
+	summary.average = summary.count ? total / summary.count : 0;
+	if( summary.count == 0 )
+	{
+		summary.min = 0;
+	}
+
+	std::uint64_t counts[BUCKETS];
+	std::uint64_t histogramTotal = 0;
+	for( int i = 0; i < BUCKETS; ++i )
+	{
+		counts[i] = histogram[i].exchange( 0, std::memory_order_relaxed );
+		histogramTotal += counts[i];
+	}
+	// the smallest bucket holding at least 99% of the durations
+	const std::uint64_t rank = histogramTotal - histogramTotal / 100;
+	std::uint64_t seen = 0;
+	summary.p99 = 0;
+	for( int i = 0; i < BUCKETS && histogramTotal > 0; ++i )
+	{
+		seen += counts[i];
+		if( seen >= rank )
+		{
+			summary.p99 = std::min( bucketLimit( i ), summary.max );
+			break;
+		}
+	}
+	return summary;
+}
+
+std::ostream &operator<<( std::ostream &out, const TimingSite::Summary &summary )
+{
+	return out << summary.count << " calls, min " << Duration{summary.min} << ", avg "
+	           << Duration{summary.average} << ", max " << Duration{summary.max} << ", p99 "
+	           << Duration{summary.p99};
+}
+}  // namespace einhard
+
+// vim: ts=4 sw=4 tw=100 noet
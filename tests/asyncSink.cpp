@@ -0,0 +1,175 @@
+/**
+ * Tests the lanes, drop policies and the synchronous bypass of the asynchronous sink
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "einhard.hpp"
+#include "asyncsink.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace einhard;
+
+// Collects records. The first write blocks until open() is called, stalling the writer thread.
+struct GatedSink : public Sink
+{
+	std::mutex mutex;
+	std::condition_variable changed;
+	bool entered = false;
+	bool opened = false;
+	std::vector<std::string> records;
+
+	void write( const Record &record ) noexcept override
+	{
+		std::unique_lock<std::mutex> lock( mutex );
+		if( !entered )
+		{
+			entered = true;
+			changed.notify_all();
+			changed.wait( lock, [this] { return opened; } );
+		}
+		records.push_back( std::string( record.data, record.size ) );
+	}
+	void waitUntilEntered()
+	{
+		std::unique_lock<std::mutex> lock( mutex );
+		changed.wait( lock, [this] { return entered; } );
+	}
+	void open()
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		opened = true;
+		changed.notify_all();
+	}
+	std::vector<std::string> snapshot()
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		return records;
+	}
+};
+
+static bool contains( const std::string &s, const std::string &part )
+{
+	return s.find( part ) != std::string::npos;
+}
+
+int main( int, char** )
+{
+	Logger<> logger( ALL, false );
+
+	{
+		// More severe lanes are drained first
+		GatedSink target;
+		AsyncSink sink( target );
+		setSink( &sink );
+		logger.info() << "stall";
+		target.waitUntilEntered();
+		for( int i = 0; i < 10; ++i )
+		{
+			logger.info() << "info " << i;
+			logger.error() << "error " << i;
+		}
+		if( sink.depth() != 21 || sink.stats( INFO ).depth != 10 || sink.stats( ERROR ).depth != 10 )
+			return 1;
+		target.open();
+		sink.flush();
+		setSink( nullptr );
+
+		const std::vector<std::string> records = target.snapshot();
+		if( records.size() != 21 || !contains( records[0], "stall" ) )
+			return 1;
+		for( int i = 0; i < 10; ++i )
+		{
+			if( !contains( records[1 + i], "error " + std::to_string( i ) ) ||
+			    !contains( records[11 + i], "info " + std::to_string( i ) ) )
+				return 1;
+		}
+		const AsyncSink::LaneStats info = sink.stats( INFO );
+		if( info.depth != 0 || info.peakDepth != 10 || info.written != 11 || info.dropped != 0 ||
+		    sink.stats( ERROR ).written != 10 || sink.depth() != 0 )
+			return 1;
+	}
+
+	{
+		// Full lanes drop the newest or oldest records, synchronous records bypass the lanes
+		GatedSink target;
+		AsyncSink sink( target, ERROR );
+		sink.configureLane( DEBUG, 4, AsyncSink::DROP_NEWEST );
+		sink.configureLane( INFO, 4, AsyncSink::DROP_OLDEST );
+		setSink( &sink );
+		logger.warn() << "stall";
+		target.waitUntilEntered();
+		for( int i = 0; i < 10; ++i )
+		{
+			logger.debug() << "debug " << i;
+			logger.info() << "info " << i;
+		}
+		logger.fatal() << "bypass";
+		std::vector<std::string> records = target.snapshot();
+		if( records.size() != 1 || !contains( records[0], "bypass" ) || sink.stats( FATAL ).bypassed != 1 )
+			return 1;
+		if( sink.stats( DEBUG ).dropped != 6 || sink.stats( INFO ).dropped != 6 )
+			return 1;
+		target.open();
+		sink.flush();
+		setSink( nullptr );
+
+		records = target.snapshot();
+		if( records.size() != 10 || !contains( records[2], "info 6" ) || !contains( records[5], "info 9" ) ||
+		    !contains( records[6], "debug 0" ) || !contains( records[9], "debug 3" ) )
+			return 1;
+	}
+
+	{
+		// Blocking lanes hold up the logging thread instead of losing records
+		GatedSink target;
+		AsyncSink sink( target );
+		sink.configureLane( WARN, 2, AsyncSink::BLOCK );
+		setSink( &sink );
+		logger.warn() << "stall";
+		target.waitUntilEntered();
+		std::thread producer( [&logger] {
+			for( int i = 0; i < 100; ++i )
+			{
+				logger.warn() << "warn " << i;
+			}
+		} );
+		while( sink.stats( WARN ).blocked == 0 )
+		{
+			std::this_thread::yield();
+		}
+		target.open();
+		producer.join();
+		sink.flush();
+		setSink( nullptr );
+
+		const AsyncSink::LaneStats warn = sink.stats( WARN );
+		const std::vector<std::string> records = target.snapshot();
+		if( warn.dropped != 0 || warn.written != 101 || warn.peakDepth != 2 || records.size() != 101 ||
+		    !contains( records[100], "warn 99" ) )
+			return 1;
+	}
+
+	// No news are good news
+	return 0;
+}
+
+// vim: ts=4 sw=4 tw=100 noet
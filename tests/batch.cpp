@@ -0,0 +1,169 @@
+/**
+ * Tests submitting many records at once with Logger::batch()
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "einhard.hpp"
+
+#include <iomanip>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace einhard;
+
+struct CollectingSink : public Sink
+{
+	std::mutex mutex;
+	std::vector<Record> meta;
+	std::vector<std::string> records;
+
+	void write( const Record &record ) noexcept override
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		meta.push_back( record );
+		records.push_back( std::string( record.data, record.size ) );
+	}
+};
+
+// The lines of s without the "[HH:MM:SS]" of the header lines
+static std::vector<std::string> lines( const std::string &s )
+{
+	std::vector<std::string> result;
+	std::size_t start = 0;
+	for( std::size_t end; ( end = s.find( '\n', start ) ) != std::string::npos; start = end + 1 )
+	{
+		std::string line = s.substr( start, end - start );
+		if( line.size() > 10 && line[0] == '[' && line[9] == ']' )
+		{
+			line.erase( 0, 10 );
+		}
+		result.push_back( line );
+	}
+	return result;
+}
+
+int main( int, char** )
+{
+	CollectingSink sink;
+	setSink( &sink );
+	Logger<> logger( INFO, false );
+	logger.setAreaName( "batch" );
+
+	{
+		Batch batch = logger.batch( WARN );
+		batch.record() << "first " << 1;
+		batch.record( "second ", 2, "\nspans two lines" );
+		if( batch.size() != 2 || !sink.records.empty() )
+			return 1;
+	}
+	if( sink.records.size() != 1 || sink.meta[0].level != WARN )
+		return 1;
+	const std::vector<std::string> expected = {"  WARN batch: first 1", "  WARN batch: second 2",
+	                                           std::string( 18 + 1 + 5, ' ' ) + "spans two lines"};
+	if( lines( sink.records[0] ) != expected )
+		return 1;
+
+	// Disabled levels collect nothing
+	{
+		Batch batch = logger.batch( DEBUG );
+		batch.record() << "not output";
+		if( batch.size() != 0 )
+			return 1;
+	}
+	if( sink.records.size() != 1 )
+		return 1;
+
+	// Manipulators do not affect the following records
+	{
+		Batch batch = logger.batch( INFO );
+		batch.record() << std::hex << std::showbase << 255;
+		batch.record() << std::setw( 4 ) << std::setfill( '*' ) << 7;
+		batch.record() << 10;
+	}
+	if( sink.records.size() != 2 ||
+	    lines( sink.records[1] ) !=
+	        std::vector<std::string>{"  INFO batch: 0xff", "  INFO batch: ***7", "  INFO batch: 10"} )
+		return 1;
+	sink.records.pop_back();
+	sink.meta.pop_back();
+
+	// submit() hands over what has been collected so far, colors are reset per record
+	logger.setColorize( true );
+	{
+		Batch batch = logger.batch( ERROR );
+		batch.record() << ~Red() << "red";
+		batch.submit();
+		batch.record() << "plain";
+		if( sink.records.size() != 2 || batch.size() != 1 )
+			return 1;
+	}
+	logger.setColorize( false );
+	if( sink.records.size() != 3 || !sink.meta[1].colored )
+		return 1;
+	std::string plain;
+	Record{ERROR, sink.records[1].data(), sink.records[1].size(), true, 0, 0, 0, 0}.withoutColor( plain );
+	if( lines( plain ) != std::vector<std::string>{" ERROR batch: red"} ||
+	    sink.records[1].find( "red\33[0m\n" ) == std::string::npos )
+		return 1;
+
+	// The records of a batch are never interleaved with the ones of other threads
+	sink.records.clear();
+	sink.meta.clear();
+	std::vector<std::thread> threads;
+	for( int t = 0; t < 4; ++t )
+	{
+		threads.emplace_back( [&logger, t] {
+			for( int b = 0; b < 20; ++b )
+			{
+				Batch batch = logger.batch( INFO );
+				for( int i = 0; i < 50; ++i )
+				{
+					batch.record( "thread ", t, " batch ", b, " record ", i );
+				}
+				logger.info() << "single";
+			}
+		} );
+	}
+	for( std::thread &thread : threads )
+	{
+		thread.join();
+	}
+	setSink( nullptr );
+	if( sink.records.size() != 4 * 20 * 2 )
+		return 1;
+	for( const std::string &record : sink.records )
+	{
+		const std::vector<std::string> l = lines( record );
+		if( l.size() == 1 && l[0] == "  INFO batch: single" )
+			continue;
+		if( l.size() != 50 )
+			return 1;
+		const std::string prefix = l[0].substr( 0, l[0].rfind( " record " ) );
+		for( int i = 0; i < 50; ++i )
+		{
+			if( l[i] != prefix + " record " + std::to_string( i ) )
+				return 1;
+		}
+	}
+
+	// No news are good news
+	return 0;
+}
+
+// vim: ts=4 sw=4 tw=100 noet
@@ -0,0 +1,85 @@
+/**
+ * Tests colorization, color stripping and the alignment of multi-line messages
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "einhard.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace einhard;
+
+struct CollectingSink : public Sink
+{
+	std::vector<std::string> records;
+	std::vector<std::string> plain;
+
+	void write( const Record &record ) noexcept override
+	{
+		records.emplace_back( record.data, record.size );
+		plain.emplace_back();
+		record.withoutColor( plain.back() );
+	}
+};
+
+int main( int, char** )
+{
+	static_assert( Red_t_::LENGTH == sizeof( "\33[01;31m" ) - 1, "wrong length of color code" );
+	static_assert( NoColor_t_::LENGTH == sizeof( "\33[0m" ) - 1, "wrong length of color code" );
+
+	CollectingSink sink;
+	setSink( &sink );
+
+	Logger<> colored( INFO, true );
+	Logger<> uncolored( INFO, false );
+
+	// The stripped colored record equals the uncolored one
+	colored.warn() << "a " << Red() << "red" << " word and " << ~Blue() << "blue " << 1;
+	uncolored.warn() << "a " << Red() << "red" << " word and " << ~Blue() << "blue " << 1;
+	if( sink.records[0] == sink.records[1] || sink.plain[0] != sink.records[1] )
+		return 1;
+	// The sticky color is reset at the end of the record
+	const std::string reset = std::string( NoColor_t_::ANSI() ) + "\n";
+	if( sink.records[0].compare( sink.records[0].size() - reset.size(), reset.size(), reset ) != 0 )
+		return 1;
+	if( sink.records[1].find( '\33' ) != std::string::npos )
+		return 1;
+
+	// Continuation lines are aligned with the first line of the message, regardless of color
+	// codes and multi-byte characters in the area name
+	const char *areas[] = {"", "net", "Ünïcödé", "日本"};
+	const std::size_t widths[] = {0, 3, 7, 4};
+	for( int i = 0; i < 4; ++i )
+	{
+		colored.setAreaName( areas[i] );
+		sink.plain.clear();
+		colored.info() << "first\nsecond";
+		const std::string &record = sink.plain.back();
+		const std::size_t indent = sizeof( "[00:00:00]  INFO: " ) - 1 + ( widths[i] ? widths[i] + 1 : 0 );
+		const std::size_t secondLine = record.find( '\n' ) + 1;
+		if( record.compare( secondLine, indent + 6, std::string( indent, ' ' ) + "second" ) != 0 )
+			return 1;
+	}
+
+	setSink( nullptr );
+
+	// No news are good news
+	return 0;
+}
+
+// vim: ts=4 sw=4 tw=100 noet
@@ -0,0 +1,182 @@
+/**
+ * Tests the flight recorder capturing and dumping low severity records
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "einhard.hpp"
+
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace einhard;
+
+struct CollectingSink : public Sink
+{
+	std::mutex mutex;
+	std::vector<std::string> records;
+
+	void write( const Record &record ) noexcept override
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		records.emplace_back( record.data, record.size );
+	}
+};
+
+static bool contains( const std::string &record, const std::string &text )
+{
+	return record.find( text ) != std::string::npos;
+}
+
+static volatile std::sig_atomic_t chained = 0;
+
+static void previousHandler( int )
+{
+	chained = 1;
+}
+
+int main( int, char** )
+{
+	CollectingSink sink;
+	setSink( &sink );
+
+	Logger<> logger( ALL, false );
+	enableFlightRecorder( INFO, ERROR, 8 );
+
+	// Only the last 8 records of each thread are kept
+	for( int i = 0; i < 10; ++i )
+	{
+		logger.debug() << "main " << i;
+	}
+	std::thread worker( [&logger]() {
+		for( int i = 0; i < 4; ++i )
+		{
+			logger.trace() << "worker " << i;
+		}
+	} );
+	worker.join();
+	logger.info() << "not captured";
+
+	if( sink.records.size() != 1 || !contains( sink.records[0], "not captured" ) )
+		return 1;
+
+	logger.error() << "failure";
+#ifdef NDEBUG
+	if( sink.records.size() != 2 )
+		return 1;
+#else
+	// 8 records of the main thread, 4 of the worker and the error itself
+	if( sink.records.size() != 14 )
+		return 1;
+	for( int i = 0; i < 8; ++i )
+	{
+		if( !contains( sink.records[1 + i], "main " + std::to_string( i + 2 ) + "\n" ) )
+			return 1;
+	}
+	for( int i = 0; i < 4; ++i )
+	{
+		if( !contains( sink.records[9 + i], "worker " + std::to_string( i ) + "\n" ) )
+			return 1;
+	}
+	if( !contains( sink.records[13], "failure" ) )
+		return 1;
+#endif
+
+	// Records are only dumped once
+	dumpFlightRecorder();
+	sink.records.clear();
+	dumpFlightRecorder();
+	if( !sink.records.empty() )
+		return 1;
+
+	logger.debug() << "after dump";
+	dumpFlightRecorder();
+#ifndef NDEBUG
+	if( sink.records.size() != 1 || !contains( sink.records[0], "after dump" ) )
+		return 1;
+#endif
+
+	disableFlightRecorder();
+	sink.records.clear();
+	logger.debug() << "direct";
+#ifndef NDEBUG
+	if( sink.records.size() != 1 )
+		return 1;
+#endif
+
+	// Records are dumped to the Sink of their Logger, or the global one once it is gone
+	sink.records.clear();
+	enableFlightRecorder( ERROR, ERROR, 8 );
+	{
+		CollectingSink own;
+		setSink( "recorder.routed", &own );
+		Logger<> routed( "recorder.routed" );
+		routed.warn() << "first";
+		logger.warn() << "global";
+		routed.error() << "second";
+		if( own.records.size() != 2 || !contains( own.records[0], "first" ) ||
+		    !contains( own.records[1], "second" ) || sink.records.size() != 1 ||
+		    !contains( sink.records[0], "global" ) )
+			return 1;
+		routed.warn() << "orphaned";
+		setSink( "recorder.routed", nullptr );
+	}
+	dumpFlightRecorder();
+	if( sink.records.size() != 2 || !contains( sink.records[1], "orphaned" ) )
+		return 1;
+
+	// A signal dumps to stdout and chains to the handler installed before
+	struct sigaction previous;
+	std::memset( &previous, 0, sizeof( previous ) );
+	previous.sa_handler = &previousHandler;
+	sigemptyset( &previous.sa_mask );
+	if( sigaction( SIGUSR1, &previous, nullptr ) != 0 || !installFlightRecorderSignalHandler( SIGUSR1 ) )
+		return 1;
+	logger.warn() << "signalled";
+	char path[] = "/tmp/einhard-flight-XXXXXX";
+	const int fd = mkstemp( path );
+	if( fd < 0 )
+		return 1;
+	std::fflush( stdout );
+	const int savedStdout = dup( STDOUT_FILENO );
+	dup2( fd, STDOUT_FILENO );
+	std::raise( SIGUSR1 );
+	dup2( savedStdout, STDOUT_FILENO );
+	close( savedStdout );
+	close( fd );
+	std::ifstream dumped( path );
+	const std::string output( ( std::istreambuf_iterator<char>( dumped ) ), std::istreambuf_iterator<char>() );
+	unlink( path );
+	if( !chained || !contains( output, " WARN: signalled\n" ) || sink.records.size() != 2 )
+		return 1;
+
+	disableFlightRecorder();
+	setSink( nullptr );
+
+	// No news are good news
+	return 0;
+}
+
+// vim: ts=4 sw=4 tw=100 noet
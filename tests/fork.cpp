@@ -0,0 +1,203 @@
+/**
+ * Tests forking while other threads are logging
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "einhard.hpp"
+#include "asyncsink.hpp"
+#include "filesink.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace einhard;
+
+const int THREADS = 4;
+const int CHILDREN = 8;
+const int CHILD_RECORDS = 100;
+
+static std::vector<std::string> readLines( const std::string &path )
+{
+	std::ifstream file( path.c_str() );
+	std::vector<std::string> lines;
+	for( std::string line; std::getline( file, line ); )
+	{
+		lines.push_back( line );
+	}
+	return lines;
+}
+
+// Runs in the child: the writer thread, the Logger tree and the per process file must work
+static int child( AsyncSink &async, FileSink &perProcess, const std::string &dir )
+{
+	setSink( "worker", &perProcess );
+	Logger<> worker( "worker" );
+	setVerbosity( "worker", INFO );
+	worker.info() << "child " << getpid();
+
+	Logger<> logger( INFO, false );
+	for( int i = 0; i < CHILD_RECORDS; ++i )
+	{
+		logger.info() << "child " << getpid() << " record " << i;
+	}
+	async.flush();
+	if( perProcess.path() != dir + "/worker-" + std::to_string( getpid() ) + ".log" )
+		return 1;
+	return 0;
+}
+
+int main( int, char** )
+{
+	char dirTemplate[] = "/tmp/einhard-fork-XXXXXX";
+	if( !mkdtemp( dirTemplate ) )
+		return 1;
+	const std::string dir = dirTemplate;
+
+	setColorize( "", false );
+	FileSink shared( dir + "/shared.log" );
+	AsyncSink async( shared );
+	// the check for complete sequences below must not lose records
+	async.configureLane( INFO, 4096, AsyncSink::BLOCK );
+	FileSink perProcess( dir + "/worker-%p.log" );
+	setSink( &async );
+
+	// The descriptors must not survive exec()
+	for( const std::string &path : {shared.path(), perProcess.path()} )
+	{
+		char link[256];
+		bool found = false;
+		for( int fd = 3; fd < 64; ++fd )
+		{
+			const std::string proc = "/proc/self/fd/" + std::to_string( fd );
+			const ssize_t size = readlink( proc.c_str(), link, sizeof( link ) );
+			if( size > 0 && std::string( link, size ) == path )
+			{
+				found = true;
+				if( !( fcntl( fd, F_GETFD ) & FD_CLOEXEC ) )
+					return 1;
+			}
+		}
+		if( !found )
+			return 1;
+	}
+
+	std::atomic<bool> stop( false );
+	std::vector<std::thread> threads;
+	for( int t = 0; t < THREADS; ++t )
+	{
+		threads.emplace_back( [&stop, t] {
+			Logger<> logger( INFO, false );
+			Logger<> reconfigured( "parent.thread" );
+			for( int i = 0; !stop.load(); ++i )
+			{
+				logger.info() << "parent " << t << " record " << i;
+				// keeps the tree and epoch locks busy
+				setVerbosity( "parent.thread", i % 2 ? INFO : WARN );
+			}
+		} );
+	}
+
+	std::set<pid_t> children;
+	for( int c = 0; c < CHILDREN; ++c )
+	{
+		usleep( 2000 );
+		const pid_t pid = fork();
+		if( pid == 0 )
+		{
+			_exit( child( async, perProcess, dir ) );
+		}
+		if( pid < 0 )
+			return 1;
+		children.insert( pid );
+	}
+	int result = 0;
+	for( pid_t pid : children )
+	{
+		int status;
+		if( waitpid( pid, &status, 0 ) != pid || !WIFEXITED( status ) || WEXITSTATUS( status ) != 0 )
+			result = 1;
+	}
+	stop = true;
+	for( std::thread &thread : threads )
+	{
+		thread.join();
+	}
+	async.flush();
+	setSink( nullptr );
+	setSink( "worker", nullptr );
+	if( result != 0 )
+		return result;
+
+	// Each record appears exactly once, complete and in order
+	std::map<std::string, int> next;
+	for( const std::string &line : readLines( dir + "/shared.log" ) )
+	{
+		const std::string::size_type start = line.find( "INFO: " );
+		const std::string::size_type end = line.rfind( " record " );
+		if( start == std::string::npos || end == std::string::npos || end < start )
+			return 1;
+		const std::string source = line.substr( start + 6, end - start - 6 );
+		const int number = std::atoi( line.c_str() + end + 8 );
+		if( number != next[source]++ || line != line.substr( 0, end + 8 ) + std::to_string( number ) )
+			return 1;
+	}
+	int childSources = 0;
+	for( const auto &source : next )
+	{
+		if( source.first.compare( 0, 6, "child " ) == 0 )
+		{
+			++childSources;
+			const pid_t pid = std::atoi( source.first.c_str() + 6 );
+			if( source.second != CHILD_RECORDS || !children.count( pid ) )
+				return 1;
+		}
+		else if( source.first.compare( 0, 7, "parent " ) != 0 )
+		{
+			return 1;
+		}
+	}
+	if( childSources != CHILDREN || next.size() != CHILDREN + THREADS )
+		return 1;
+
+	// Each child wrote to a file of its own
+	for( pid_t pid : children )
+	{
+		const std::string path = dir + "/worker-" + std::to_string( pid ) + ".log";
+		const std::vector<std::string> lines = readLines( path );
+		if( lines.size() != 1 || lines[0].find( "child " + std::to_string( pid ) ) == std::string::npos )
+			return 1;
+		unlink( path.c_str() );
+	}
+	unlink( perProcess.path().c_str() );
+	unlink( shared.path().c_str() );
+	rmdir( dir.c_str() );
+
+	// No news are good news
+	return 0;
+}
+
+// vim: ts=4 sw=4 tw=100 noet
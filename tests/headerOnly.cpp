@@ -0,0 +1,72 @@
+/**
+ * Tests that the header-only Einhard shares its state between translation units
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "einhard.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace einhard;
+
+// defined in headerOnlyOther.cpp
+void logFromOtherTranslationUnit( const std::string &message );
+
+struct CollectingSink : public Sink
+{
+	std::vector<std::string> records;
+
+	void write( const Record &record ) noexcept override
+	{
+		records.push_back( std::string( record.data, record.size ) );
+	}
+};
+
+int main( int, char** )
+{
+	CollectingSink sink;
+	setSink( &sink );
+
+	logFromOtherTranslationUnit( "sink" );
+	if( sink.records.size() != 1 || sink.records[0].find( " INFO other: sink\n" ) == std::string::npos )
+		return 1;
+
+	// Records captured in the other translation unit are dumped from this one
+	enableFlightRecorder( WARN, OFF );
+	logFromOtherTranslationUnit( "captured" );
+	if( sink.records.size() != 1 )
+		return 1;
+	disableFlightRecorder();
+	dumpFlightRecorder();
+	if( sink.records.size() != 2 || sink.records[1].find( "other: captured\n" ) == std::string::npos )
+		return 1;
+
+	Logger<> logger( INFO, false );
+	logger.setAreaName( "here" );
+	logger.info() << "multi\nline";
+	const std::string indented = "here: multi\n" + std::string( 23, ' ' ) + "line\n";
+	if( sink.records.size() != 3 || sink.records[2].find( indented ) == std::string::npos )
+		return 1;
+
+	setSink( nullptr );
+
+	// No news are good news
+	return 0;
+}
+
+// vim: ts=4 sw=4 tw=100 noet
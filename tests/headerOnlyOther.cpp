@@ -0,0 +1,31 @@
+/**
+ * The second translation unit of the headerOnly test
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "einhard.hpp"
+
+#include <string>
+
+void logFromOtherTranslationUnit( const std::string &message )
+{
+	einhard::Logger<> logger( einhard::INFO, false );
+	logger.setAreaName( "other" );
+	logger.info() << message;
+}
+
+// vim: ts=4 sw=4 tw=100 noet
@@ -0,0 +1,129 @@
+/**
+ * Tests the parsing of LogLevel names and lists of verbosities
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "einhard.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace einhard;
+
+static bool parsesTo( const char *text, LogLevel expected )
+{
+	LogLevel level = static_cast<LogLevel>( 42 );
+	return parseLogLevel( text, level ) && level == expected;
+}
+
+static bool rejects( const std::string &text )
+{
+	LogLevel level = INFO;
+	return !parseLogLevel( text, level ) && level == INFO;
+}
+
+int main( int, char** )
+{
+	const LogLevel levels[] = {ALL, TRACE, DEBUG, INFO, WARN, ERROR, FATAL, OFF};
+	for( LogLevel level : levels )
+	{
+		// The unpadded names round trip, the padded ones are the same names right aligned
+		const std::string name = getLogLevelName( level );
+		const std::string padded = getLogLevelString( level );
+		if( !parsesTo( name.c_str(), level ) || getLogLevel( name ) != level || padded.size() != 5 ||
+		    padded.compare( 5 - name.size(), name.size(), name ) != 0 )
+			return 1;
+		const char digit[] = {static_cast<char>( '0' + level ), '\0'};
+		if( !parsesTo( digit, level ) )
+			return 1;
+	}
+	if( std::strcmp( getLogLevelString( WARN ), getLogLevelString<WARN>() ) != 0 ||
+	    std::strcmp( getLogLevelName( static_cast<LogLevel>( 8 ) ), "" ) != 0 )
+		return 1;
+
+	// Any case and the aliases
+	if( !parsesTo( "warn", WARN ) || !parsesTo( "Warning", WARN ) || !parsesTo( "ERR", ERROR ) ||
+	    !parsesTo( "dbg", DEBUG ) || !parsesTo( "information", INFO ) || !parsesTo( "Critical", FATAL ) ||
+	    !parsesTo( "crit", FATAL ) || !parsesTo( "None", OFF ) || !parsesTo( "tRaCe", TRACE ) )
+		return 1;
+
+	// Near misses, including names sharing a slot of the hash with an alias
+	const char *invalid[] = {"", "8", "-1", "01", "warnings", "war", "errr", "inform", " info", "info ",
+	                         "ALL\n", "tracf", "uarn", "informatioN1", "\xe9rror", "of"};
+	for( const char *text : invalid )
+	{
+		if( !rejects( text ) )
+			return 1;
+	}
+	if( !rejects( std::string( "info\0", 5 ) ) )
+		return 1;
+	LogLevel level;
+	if( !parseLogLevel( "debugging", 5, level ) || level != DEBUG )
+		return 1;
+#if __cplusplus >= 201703L
+	if( !parseLogLevel( std::string_view( "error, info" ).substr( 0, 5 ), level ) || level != ERROR )
+		return 1;
+#endif
+
+	// getLogLevel() still throws
+	try
+	{
+		getLogLevel( "verbose" );
+		return 1;
+	}
+	catch( const std::invalid_argument & )
+	{
+	}
+
+	// Lists of verbosities
+	std::vector<std::pair<std::string, LogLevel>> specs;
+	const auto collect = [&specs]( const char *area, std::size_t size, LogLevel level ) {
+		specs.emplace_back( std::string( area, size ), level );
+	};
+	if( !parseLevelSpecs( "WARN, app.net = debug ,,app.net.http=3,\t=err,", collect ) || specs.size() != 4 ||
+	    specs[0] != std::make_pair( std::string(), WARN ) ||
+	    specs[1] != std::make_pair( std::string( "app.net" ), DEBUG ) ||
+	    specs[2] != std::make_pair( std::string( "app.net.http" ), INFO ) ||
+	    specs[3] != std::make_pair( std::string(), ERROR ) )
+		return 1;
+	specs.clear();
+	if( !parseLevelSpecs( "", collect ) || !parseLevelSpecs( " , ", collect ) || !specs.empty() )
+		return 1;
+	std::size_t errorOffset = 0;
+	if( parseLevelSpecs( "a=info,b=loud,c=warn", collect, &errorOffset ) || errorOffset != 7 ||
+	    specs.size() != 1 || parseLevelSpecs( "a=", collect, &errorOffset ) || errorOffset != 0 )
+		return 1;
+
+	// Applying them changes nothing unless all of them are valid
+	Logger<> http( "app.net.http" );
+	Logger<> db( "app.db" );
+	if( !setVerbosities( "error,app=info,app.net.http=trace" ) || db.getVerbosity() != INFO ||
+	    http.getVerbosity() != TRACE || getVerbosity( "other" ) != ERROR )
+		return 1;
+	if( setVerbosities( "app=off,app.db=wrong", &errorOffset ) || errorOffset != 8 || db.getVerbosity() != INFO )
+		return 1;
+	if( !setVerbosities( "app.net=0" ) || http.getVerbosity() != TRACE || getVerbosity( "app.net" ) != ALL )
+		return 1;
+
+	// No news are good news
+	return 0;
+}
+
+// vim: ts=4 sw=4 tw=100 noet
@@ -0,0 +1,175 @@
+/**
+ * Tests that einhard-stats counts the records of a file written by Einhard and replays them
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "einhard.hpp"
+#include "filesink.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace einhard;
+
+// Whether the command succeeds, its stdout is stored in output
+static bool run( const std::string &command, std::string &output )
+{
+	output.clear();
+	FILE *pipe = popen( command.c_str(), "r" );
+	if( !pipe )
+	{
+		return false;
+	}
+	char chunk[4096];
+	for( std::size_t size; ( size = std::fread( chunk, 1, sizeof( chunk ), pipe ) ) > 0; )
+	{
+		output.append( chunk, size );
+	}
+	return pclose( pipe ) == 0;
+}
+
+static std::vector<std::string> readLines( const std::string &path )
+{
+	std::ifstream file( path.c_str() );
+	std::vector<std::string> lines;
+	for( std::string line; std::getline( file, line ); )
+	{
+		lines.push_back( line );
+	}
+	return lines;
+}
+
+static bool contains( const std::string &s, const std::string &part )
+{
+	return s.find( part ) != std::string::npos;
+}
+
+int main( int argc, char **argv )
+{
+	if( argc != 2 )
+		return 1;
+	const std::string tool = argv[1];
+	char dirTemplate[] = "/tmp/einhard-stats-XXXXXX";
+	if( !mkdtemp( dirTemplate ) )
+		return 1;
+	const std::string dir = dirTemplate;
+	const std::string capture = dir + "/capture.log";
+	const std::string replayed = dir + "/replayed.log";
+
+	// Not written by Einhard, counted as unparsed
+	std::ofstream( capture.c_str() ) << "starting\n";
+	{
+		// keep the colors, they must be skipped
+		FileSink sink( capture, false );
+		setSink( &sink );
+		Logger<> net( ALL, true );
+		net.setAreaName( "app.net" );
+		Logger<> db( ALL, false );
+		db.setAreaName( "app.db" );
+		Logger<> plain( ALL, false );
+		for( int i = 0; i < 1000; ++i )
+		{
+			net.info() << "sent " << i << " bytes";
+			if( i % 100 == 0 )
+			{
+				db.warn() << "slow query " << i << "\n[not a header] took " << i << " ms\n  plan";
+			}
+		}
+		for( int i = 0; i < 5; ++i )
+		{
+			plain.error() << "failure";
+		}
+		setSink( nullptr );
+	}
+
+	// Small chunks, so records end up in different chunks and threads
+	std::string report;
+	if( !run( tool + " -j 4 -c 1000 -n 2 " + capture, report ) || !contains( report, "1015 records" ) ||
+	    !contains( report, "9 B before the first record" ) || !contains( report, "Peak: " ) )
+		return 1;
+	std::istringstream table( report.substr( report.find( "share" ) ) );
+	std::string line;
+	std::getline( table, line );
+	std::getline( table, line );
+	if( !contains( line, "  1000 " ) || !contains( line, "INFO   app.net" ) )
+		return 1;
+	std::getline( table, line );
+	if( !contains( line, "  10 " ) || !contains( line, "WARN   app.db" ) )
+		return 1;
+	std::getline( table, line );
+	if( !contains( line, "  5 " ) || !contains( line, "ERROR  (none)" ) )
+		return 1;
+	if( !contains( report, "1000  INFO   app.net: sent # bytes\n" ) ||
+	    !contains( report, "10  WARN   app.db: slow query #\n" ) || contains( report, "failure" ) )
+		return 1;
+
+	// Replays the records with their continuation lines, without the colors
+	std::string output;
+	if( !run( tool + " -r -s 0 -o " + replayed + " " + capture + " 2> /dev/null", output ) )
+		return 1;
+	const std::vector<std::string> lines = readLines( replayed );
+	// the continuation lines are indented by the width of "[hh:mm:ss]  WARN app.db: "
+	const std::string indent( 25, ' ' );
+	if( lines.size() != 1015 + 2 * 10 || lines[0].substr( 10 ) != "  INFO app.net: sent 0 bytes" ||
+	    lines[1].substr( 10 ) != "  WARN app.db: slow query 0" ||
+	    lines[2] != indent + "[not a header] took 0 ms" || lines[3] != indent + "  plan" ||
+	    lines.back().substr( 10 ) != " ERROR: failure" )
+		return 1;
+
+	// Counts the seconds after midnight as the next day, also across chunks
+	{
+		std::ofstream midnight( capture.c_str() );
+		midnight << "[23:59:58]  INFO: a\n[23:59:58]  INFO: b\n[23:59:59]  INFO: c\n"
+		         << "[00:00:00]  INFO: d\n[00:00:00]  INFO: e\n[00:00:00]  INFO: f\n[00:00:01]  INFO: g\n";
+	}
+	if( !run( tool + " -j 2 -c 40 -n 0 " + capture, report ) ||
+	    !contains( report, "Seconds with records: 4 between day 1 23:59:58 and day 2 00:00:01" ) ||
+	    !contains( report, "Peak: 3 records/s at day 2 00:00:00" ) )
+		return 1;
+
+	// Built with NDEBUG, DEBUG records cannot be replayed and are reported
+	std::ofstream( capture.c_str() ) << "[12:00:00]  INFO: kept\n[12:00:00] DEBUG: detail\n";
+	if( !run( tool + " -r -s 0 -o " + replayed + " " + capture + " 2>&1", output ) )
+		return 1;
+#ifdef NDEBUG
+	if( !contains( output, "replayed 1 records" ) || !contains( output, "skipped 1 DEBUG and TRACE records" ) )
+		return 1;
+#else
+	if( !contains( output, "replayed 2 records" ) || contains( output, "skipped" ) )
+		return 1;
+#endif
+
+	// Rejects invalid arguments
+	if( run( tool + " -j 0 " + capture + " 2> /dev/null", output ) ||
+	    run( tool + " -r " + capture + " " + capture + " 2> /dev/null", output ) ||
+	    run( tool + " " + dir + "/missing.log 2> /dev/null", output ) )
+		return 1;
+
+	unlink( capture.c_str() );
+	unlink( replayed.c_str() );
+	rmdir( dir.c_str() );
+
+	// No news are good news
+	return 0;
+}
+
+// vim: ts=4 sw=4 tw=100 noet
@@ -0,0 +1,135 @@
+/**
+ * Tests the inheritance of settings in the hierarchy of Logger names
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "einhard.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace einhard;
+
+struct CollectingSink : public Sink
+{
+	std::vector<std::string> records;
+
+	void write( const Record &record ) noexcept override
+	{
+		records.push_back( std::string( record.data, record.size ) );
+	}
+};
+
+static bool contains( const std::string &s, const std::string &part )
+{
+	return s.find( part ) != std::string::npos;
+}
+
+int main( int, char** )
+{
+	CollectingSink global;
+	CollectingSink net;
+	setSink( &global );
+	setColorize( "", false );
+
+	// Without any settings the defaults of the root apply
+	Logger<> http( "app.net.http" );
+	Logger<> db( "app.db" );
+	if( http.getVerbosity() != WARN || http.isEnabled<INFO>() || getVerbosity( "app.net.http" ) != WARN )
+		return 1;
+
+	setVerbosity( "app", DEBUG );
+	if( !http.isEnabled<DEBUG>() || !db.isEnabled<DEBUG>() || getVerbosity( "app.net" ) != DEBUG )
+		return 1;
+	// Names without a node resolve like their nearest ancestor
+	if( getVerbosity( "app.cache.lookup" ) != DEBUG || getVerbosity( "other" ) != WARN )
+		return 1;
+	setVerbosity( "app.cache", ERROR );
+	if( getVerbosity( "app.cache.lookup" ) != ERROR )
+		return 1;
+
+	// A setting on a child overrides the one of the parent for the child's subtree only
+	setVerbosity( "app.net", ERROR );
+	if( http.isEnabled<WARN>() || !http.isEnabled<ERROR>() || !db.isEnabled<DEBUG>() )
+		return 1;
+
+	setSink( "app.net", &net );
+	http.error() << "to net";
+	db.info() << "to global";
+	if( net.records.size() != 1 || !contains( net.records[0], "ERROR app.net.http: to net" ) ||
+	    global.records.size() != 1 || !contains( global.records[0], " INFO app.db: to global" ) )
+		return 1;
+
+	setColorize( "app.net", true );
+	if( !http.getColorize() || db.getColorize() )
+		return 1;
+
+	// Deep hierarchies resolve like shallow ones
+	Logger<> deep( "app.net.http.client.pool.connection.socket" );
+	if( deep.getVerbosity() != ERROR || !deep.getColorize() )
+		return 1;
+	deep.error() << "deep";
+	if( net.records.size() != 2 )
+		return 1;
+
+	// Copies stay attached, assigning a plain Logger detaches
+	Logger<> copy( http );
+	Logger<> assigned( INFO, false );
+	assigned = db;
+	setVerbosity( "app", TRACE );
+	if( copy.getVerbosity() != ERROR || assigned.getVerbosity() != TRACE )
+		return 1;
+	resetConfiguration( "app.net" );
+	if( copy.getVerbosity() != TRACE || copy.getColorize() || deep.getVerbosity() != TRACE )
+		return 1;
+	assigned = Logger<>( FATAL, false );
+	setVerbosity( "app", INFO );
+	if( assigned.getVerbosity() != FATAL || copy.getVerbosity() != INFO )
+		return 1;
+
+	// Destroyed Logger objects are no longer updated
+	{
+		Logger<> temporary( "app.temporary" );
+		if( temporary.getVerbosity() != INFO )
+			return 1;
+	}
+	setVerbosity( "app", WARN );
+
+	// The compile time limit still applies
+	Logger<WARN> limited( "app.limited" );
+	setVerbosity( "app", ALL );
+	if( limited.isEnabled<INFO>() || !limited.isEnabled<WARN>() )
+		return 1;
+
+	global.records.clear();
+	net.records.clear();
+	http.info() << "global again";
+	if( global.records.size() != 1 || !net.records.empty() )
+		return 1;
+
+	resetConfiguration( "app" );
+	resetConfiguration( "" );
+	if( http.getVerbosity() != WARN )
+		return 1;
+
+	setSink( nullptr );
+
+	// No news are good news
+	return 0;
+}
+
+// vim: ts=4 sw=4 tw=100 noet
@@ -0,0 +1,119 @@
+/**
+ * Tests logging binary payloads with hex(), hexdump() and blob()
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "einhard.hpp"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace einhard;
+
+struct CollectingSink : public Sink
+{
+	std::vector<std::string> records;
+
+	void write( const Record &record ) noexcept override
+	{
+		records.push_back( std::string( record.data, record.size ) );
+	}
+};
+
+template <typename T> static std::string toString( const T &value )
+{
+	std::ostringstream s;
+	s << value;
+	return s.str();
+}
+
+static bool endsWith( const std::string &s, const std::string &suffix )
+{
+	return s.size() >= suffix.size() && s.compare( s.size() - suffix.size(), suffix.size(), suffix ) == 0;
+}
+
+int main( int, char** )
+{
+	unsigned char bytes[256];
+	for( int i = 0; i < 256; ++i )
+	{
+		bytes[i] = static_cast<unsigned char>( i );
+	}
+
+	// All byte values, in the vectorized loop as well as in the remainder
+	std::string expected;
+	for( int i = 0; i < 256; ++i )
+	{
+		expected += "0123456789abcdef"[i >> 4];
+		expected += "0123456789abcdef"[i & 0x0f];
+	}
+	for( std::size_t offset = 0; offset < 20; ++offset )
+	{
+		for( std::size_t size = 0; size < 40; ++size )
+		{
+			if( toString( hex( bytes + offset, size ) ) != expected.substr( 2 * offset, 2 * size ) )
+				return 1;
+		}
+	}
+	if( toString( hex( bytes, 256 ) ) != expected )
+		return 1;
+
+	if( toString( blob( "GET /\\ \r\n\t\x7f\x01", 12 ) ) != "GET /\\\\ \\r\\n\\t\\x7f\\x01" )
+		return 1;
+
+	// Truncation, by argument and by default
+	if( toString( hex( bytes, 256, 4 ) ) != "00010203... (252 more bytes)" )
+		return 1;
+	setPayloadLimit( 2 );
+	if( toString( blob( "abcdef", 6 ) ) != "ab... (4 more bytes)" || payloadLimit() != 2 )
+		return 1;
+	setPayloadLimit( SIZE_MAX );
+	if( toString( blob( "abcdef", 6 ) ) != "abcdef" )
+		return 1;
+
+	// Hexdumps start each line on a new line of the record, aligned with the message
+	CollectingSink sink;
+	setSink( &sink );
+	Logger<> logger( INFO, false );
+	logger.setAreaName( "net" );
+	logger.info() << "packet" << hexdump( "0123456789abcdef\x80XYZ", 20 );
+	logger.info() << "truncated" << hexdump( bytes, 256, 17 );
+	setSink( nullptr );
+
+	if( sink.records.size() != 2 )
+		return 1;
+	std::istringstream lines( sink.records[0] );
+	std::string first, second, third, rest;
+	std::getline( lines, first );
+	std::getline( lines, second );
+	std::getline( lines, third );
+	if( std::getline( lines, rest ) || !endsWith( first, "INFO net: packet" ) )
+		return 1;
+	const std::string indent( first.size() - 6, ' ' );
+	if( second != indent + "00000000  30 31 32 33 34 35 36 37  38 39 61 62 63 64 65 66  |0123456789abcdef|" ||
+	    third != indent + "00000010  80 58 59 5a                                       |.XYZ|" )
+		return 1;
+	if( !endsWith( sink.records[1], "00000010  10                                                |.|\n" +
+	                                    indent + "... (239 more bytes)\n" ) )
+		return 1;
+
+	// No news are good news
+	return 0;
+}
+
+// vim: ts=4 sw=4 tw=100 noet
@@ -0,0 +1,98 @@
+/**
+ * Tests reconfiguring a Logger while other threads log through it
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "einhard.hpp"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace einhard;
+
+static const char AREA_A[] = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
+static const char AREA_B[] = "bbbbbbbbbbbbbbbbbbbb";
+
+// Checks every record for a consistent area name and separator instead of printing it
+struct CheckingSink : public Sink
+{
+	std::atomic<unsigned long> records{0};
+	std::atomic<unsigned long> torn{0};
+
+	void write( const Record &record ) noexcept override
+	{
+		++records;
+		const std::string text( record.data, record.size );
+		const bool a = text.find( std::string( " " ) + AREA_A + ": " ) != std::string::npos;
+		const bool b = text.find( std::string( " " ) + AREA_B + ": " ) != std::string::npos;
+		const bool colon = text[3] == ':' && text[6] == ':';
+		const bool dash = text[3] == '-' && text[6] == '-';
+		if( a == b || colon == dash || text.find( '\33' ) != std::string::npos )
+		{
+			++torn;
+		}
+	}
+};
+
+int main( int, char** )
+{
+	CheckingSink sink;
+	setSink( &sink );
+
+	Logger<> logger( INFO, false );
+	logger.setAreaName( AREA_A );
+
+	std::atomic<bool> stop( false );
+	std::vector<std::thread> readers;
+	for( int t = 0; t < 4; ++t )
+	{
+		readers.emplace_back( [&logger, &stop]() {
+			while( !stop.load() )
+			{
+				logger.info() << "message";
+				logger.debug() << "filtered";
+			}
+		} );
+	}
+
+	for( int i = 0; i < 2000; ++i )
+	{
+		logger.setAreaName( i % 2 ? AREA_A : AREA_B );
+		logger.setTimeSeparator( i % 3 ? ':' : '-' );
+		logger.setColorize( false );
+		logger.setVerbosity( i % 2 ? INFO : ALL );
+		Logger<> copy( logger );
+		copy = logger;
+	}
+	stop = true;
+	for( auto &reader : readers )
+	{
+		reader.join();
+	}
+
+	setSink( nullptr );
+
+	if( sink.records == 0 || sink.torn != 0 )
+		return 1;
+
+	// No news are good news
+	return 0;
+}
+
+// vim: ts=4 sw=4 tw=100 noet
@@ -0,0 +1,118 @@
+/**
+ * Tests the pooling and trimming of the buffers records are formatted in
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "einhard.hpp"
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace einhard;
+
+struct CollectingSink : public Sink
+{
+	std::mutex mutex;
+	std::vector<std::string> records;
+
+	void write( const Record &record ) noexcept override
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		records.push_back( std::string( record.data, record.size ) );
+	}
+};
+
+static Logger<> logger( INFO, false );
+
+// Logs a record of its own while being formatted into another one
+struct Chatty
+{
+};
+
+static std::ostream &operator<<( std::ostream &out, const Chatty & )
+{
+	logger.info() << "inner " << 42;
+	return out << "chatty";
+}
+
+static bool endsWith( const std::string &s, const std::string &suffix )
+{
+	return s.size() >= suffix.size() && s.compare( s.size() - suffix.size(), suffix.size(), suffix ) == 0;
+}
+
+int main( int, char** )
+{
+	CollectingSink sink;
+	setSink( &sink );
+	logger.setAreaName( "buffers" );
+
+	// Sequential short-lived threads reuse the buffer of their predecessors
+	logger.info() << "warm up";
+	const RecordBufferStats initial = recordBufferStats();
+	for( int i = 0; i < 100; ++i )
+	{
+		std::thread( [i]() { logger.info() << "thread " << i; } ).join();
+	}
+	const RecordBufferStats afterThreads = recordBufferStats();
+	if( sink.records.size() != 101 || afterThreads.allocated > initial.allocated + 1 ||
+	    afterThreads.buffers > initial.buffers + 1 || afterThreads.pooledBuffers < 1 )
+		return 1;
+
+	// A huge record does not leave the buffer inflated
+	setRecordBufferLimits( 16 * 1024, 1024 * 1024 );
+	std::string lines;
+	for( int i = 0; i < 100; ++i )
+	{
+		lines += std::string( 1000, 'x' ) + '\n';
+	}
+	logger.info() << lines;
+	const RecordBufferStats afterHuge = recordBufferStats();
+	if( sink.records.back().size() < 100 * 1000 || afterHuge.trimmed != afterThreads.trimmed + 1 ||
+	    afterHuge.peakBytes < 100 * 1000 || afterHuge.bytes > afterHuge.buffers * 16 * 1024 )
+		return 1;
+
+	// Records formatted while formatting a record get their own buffer
+	logger.info() << "outer " << Chatty() << " done";
+	if( !endsWith( sink.records[sink.records.size() - 2], "buffers: inner 42\n" ) ||
+	    !endsWith( sink.records.back(), "buffers: outer chatty done\n" ) )
+		return 1;
+
+	// Manipulators do not affect the following records
+	logger.info() << std::hex << std::showbase << 255;
+	logger.info() << 255 << ' ' << 1.0 / 3;
+	if( !endsWith( sink.records[sink.records.size() - 2], ": 0xff\n" ) ||
+	    !endsWith( sink.records.back(), ": 255 0.333333\n" ) )
+		return 1;
+
+	// An empty pool frees the buffers returned to it
+	setRecordBufferLimits( 16 * 1024, 0 );
+	const RecordBufferStats drained = recordBufferStats();
+	std::thread( []() { logger.info() << "gone"; } ).join();
+	const RecordBufferStats afterDrain = recordBufferStats();
+	if( drained.pooledBuffers != 0 || drained.pooledBytes != 0 || afterDrain.pooledBuffers != 0 ||
+	    afterDrain.buffers != drained.buffers || afterDrain.bytes != drained.bytes )
+		return 1;
+
+	setSink( nullptr );
+
+	// No news are good news
+	return 0;
+}
+
+// vim: ts=4 sw=4 tw=100 noet
@@ -0,0 +1,119 @@
+/**
+ * Tests random and key based sampling of records
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "einhard.hpp"
+
+#include <string>
+
+using namespace einhard;
+
+struct CountingSink : public Sink
+{
+	unsigned long records = 0;
+
+	void write( const Record & ) noexcept override
+	{
+		++records;
+	}
+};
+
+int main( int, char** )
+{
+	CountingSink sink;
+	setSink( &sink );
+
+	Logger<> db( ALL, false );
+	db.setAreaName( "db" );
+	Logger<> net( ALL, false );
+	net.setAreaName( "net" );
+
+	db.setSampling( WARN, 0.1 );
+	if( db.getSampling( WARN ) < 0.0999 || db.getSampling( WARN ) > 0.1001 || db.getSampling( INFO ) != 1 )
+		return 1;
+
+	// Roughly 10% of the sampled records are kept, other levels and areas are unaffected
+	const int records = 100000;
+	for( int i = 0; i < records; ++i )
+	{
+		db.warn() << "sampled " << i;
+	}
+	if( sink.records < records * 0.09 || sink.records > records * 0.11 )
+		return 1;
+	sink.records = 0;
+	for( int i = 0; i < 1000; ++i )
+	{
+		db.info() << "info";
+		net.warn() << "other area";
+		db.warn( "variadic ", i );
+	}
+	if( sink.records < 2000 || sink.records > 2200 )
+		return 1;
+
+	// Records with the same key are kept or dropped together
+	unsigned long keptKeys = 0;
+	for( int request = 0; request < 10000; ++request )
+	{
+		sink.records = 0;
+		const SampleKey key( "request-" + std::to_string( request ) );
+		for( int i = 0; i < 10; ++i )
+		{
+			db.log<WARN>( key ) << "step " << i;
+		}
+		if( sink.records != 0 && sink.records != 10 )
+			return 1;
+		keptKeys += sink.records / 10;
+	}
+	if( keptKeys < 900 || keptKeys > 1100 )
+		return 1;
+
+	// A key kept at a low rate is also kept at a higher one
+	const SampleKey key( 42 );
+	db.setSampling( WARN, 0.001 );
+	for( std::uint64_t id = 0; id < 100000; ++id )
+	{
+		sink.records = 0;
+		db.log<WARN>( SampleKey( id ) ) << "low";
+		if( sink.records == 1 )
+		{
+			db.setSampling( WARN, 0.5 );
+			db.log<WARN>( SampleKey( id ) ) << "high";
+			if( sink.records != 2 )
+				return 1;
+			break;
+		}
+	}
+
+	db.setSampling( WARN, 0 );
+	sink.records = 0;
+	db.warn() << "never";
+	db.log<WARN>( key ) << "never";
+	if( sink.records != 0 )
+		return 1;
+	db.setSampling( WARN, 1 );
+	db.warn() << "always";
+	if( sink.records != 1 || db.getSampling( WARN ) != 1 )
+		return 1;
+
+	setSink( nullptr );
+
+	// No news are good news
+	return 0;
+}
+
+// vim: ts=4 sw=4 tw=100 noet
@@ -0,0 +1,138 @@
+/**
+ * Tests the scoped timers and the aggregation of their durations
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "einhard.hpp"
+#include "timer.hpp"
+
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace einhard;
+
+struct CollectingSink : public Sink
+{
+	std::vector<std::string> records;
+
+	void write( const Record &record ) noexcept override
+	{
+		records.push_back( std::string( record.data, record.size ) );
+	}
+};
+
+static bool contains( const std::string &s, const std::string &part )
+{
+	return s.find( part ) != std::string::npos;
+}
+
+static void sleepMilliseconds( int milliseconds )
+{
+	std::this_thread::sleep_for( std::chrono::milliseconds( milliseconds ) );
+}
+
+// The macros also work where the type of the logger depends on a template parameter
+template<LogLevel MAX>
+static void timedInTemplate( Logger<MAX> &logger )
+{
+	EINHARD_TIMED_SCOPE( logger, INFO, "template" );
+	EINHARD_AGGREGATED_TIMED_SCOPE( logger, INFO, "aggregated", 1000 );
+}
+
+int main( int, char** )
+{
+	// The clock measures real time
+	FastClock::calibrate();
+	const FastClock::ticks start = FastClock::now();
+	sleepMilliseconds( 20 );
+	const std::uint64_t slept = FastClock::toNanoseconds( FastClock::now() - start );
+	if( slept < 19000000 || slept > 200000000 )
+		return 1;
+
+	std::ostringstream formatted;
+	formatted << Duration{999} << ' ' << Duration{1500} << ' ' << Duration{2000000000} << ' '
+	          << Duration{999400} << ' ' << Duration{999999} << ' ' << Duration{3600000000000};
+	if( formatted.str() != "999 ns 1.5 us 2 s 999 us 1 ms 3600 s" )
+		return 1;
+
+	CollectingSink sink;
+	setSink( &sink );
+	Logger<> logger( INFO, false );
+	logger.setAreaName( "timer" );
+
+	{
+		EINHARD_TIMED_SCOPE( logger, INFO, "parsing" );
+		sleepMilliseconds( 1 );
+	}
+	if( sink.records.size() != 1 || !contains( sink.records[0], " INFO timer: parsing took " ) ||
+	    !contains( sink.records[0], " ms" ) )
+		return 1;
+
+	// Durations below the threshold and disabled levels are not logged
+	{
+		EINHARD_TIMED_SCOPE( logger, INFO, "fast", 1000000000 );
+	}
+	{
+		EINHARD_TIMED_SCOPE( logger, DEBUG, "disabled" );
+		ScopedTimer<DEBUG, Logger<>> timer( logger, "disabled" );
+		sleepMilliseconds( 1 );
+		if( timer.elapsed() != 0 )
+			return 1;
+	}
+	if( sink.records.size() != 1 )
+		return 1;
+	timedInTemplate( logger );
+	if( sink.records.size() != 2 || !contains( sink.records[1], " INFO timer: template took " ) )
+		return 1;
+
+	// Aggregated durations are logged once per period
+	sink.records.clear();
+	for( int i = 0; i < 50; ++i )
+	{
+		EINHARD_AGGREGATED_TIMED_SCOPE( logger, WARN, "loop", 0.05 );
+		sleepMilliseconds( 2 );
+	}
+	if( sink.records.empty() || sink.records.size() > 5 ||
+	    !contains( sink.records[0], " WARN timer: loop: " ) || !contains( sink.records[0], " calls, min " ) ||
+	    !contains( sink.records[0], ", p99 " ) )
+		return 1;
+
+	// The summary reflects the added durations
+	TimingSite site( "site", 1000 );
+	TimingSite::Summary summary;
+	for( std::uint64_t ns = 1; ns <= 1000; ++ns )
+	{
+		if( site.add( ns * 1000, 0, summary ) )
+			return 1;
+	}
+	summary = site.takeSummary();
+	if( summary.count != 1000 || summary.min != 1000 || summary.max != 1000000 || summary.average != 500500 ||
+	    summary.p99 < 990000 || summary.p99 > 1000000 )
+		return 1;
+	summary = site.takeSummary();
+	if( summary.count != 0 || summary.min != 0 || summary.max != 0 || summary.p99 != 0 )
+		return 1;
+
+	setSink( nullptr );
+
+	// No news are good news
+	return 0;
+}
+
+// vim: ts=4 sw=4 tw=100 noet
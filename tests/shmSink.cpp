@@ -0,0 +1,144 @@
+/**
+ * Tests logging into a shared memory ring buffer and reading it back
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "einhard.hpp"
+#include "shmsink.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace einhard;
+
+int main( int, char** )
+{
+	const std::string name = "/einhard-test-" + std::to_string( getpid() );
+
+	ShmRingSink sink( name.c_str(), 8, 128 );
+	sink.unlinkOnDestroy( true );
+	Sink *previous = setSink( &sink );
+
+	Logger<> logger( INFO, false );
+	logger.setAreaName( "shm" );
+
+	ShmRingReader reader( name.c_str() );
+	std::string record;
+	LogLevel level;
+	if( reader.next( record, level ) != ShmRingReader::EMPTY )
+		return 1;
+
+	logger.warn() << "first";
+	logger.info() << "second\nline";
+	if( reader.next( record, level ) != ShmRingReader::OK )
+		return 1;
+	if( level != WARN || record.find( " WARN shm: first\n" ) == std::string::npos )
+		return 1;
+	if( reader.next( record, level ) != ShmRingReader::OK )
+		return 1;
+	if( level != INFO || record.find( "second\n" ) == std::string::npos ||
+	    record.back() != '\n' )
+		return 1;
+	if( reader.next( record, level ) != ShmRingReader::EMPTY )
+		return 1;
+
+	// Records longer than a slot are truncated
+	logger.info() << std::string( 200, 'x' );
+	if( reader.next( record, level ) != ShmRingReader::OK )
+		return 1;
+	if( record.size() != 128 - 16 || record.back() != '\n' || sink.truncated() != 1 )
+		return 1;
+
+	// Overrunning the reader must be detected
+	for( int i = 0; i < 20; ++i )
+	{
+		logger.info() << "record " << i;
+	}
+	if( reader.next( record, level ) != ShmRingReader::OVERRUN || reader.lost() != 12 )
+		return 1;
+	for( int i = 12; i < 20; ++i )
+	{
+		if( reader.next( record, level ) != ShmRingReader::OK )
+			return 1;
+		if( record.find( "record " + std::to_string( i ) + "\n" ) == std::string::npos )
+			return 1;
+	}
+	if( reader.next( record, level ) != ShmRingReader::EMPTY )
+		return 1;
+
+	// A second sink of the same geometry attaches to the ring without resetting it
+	{
+		ShmRingSink attached( name.c_str(), 8, 128 );
+		setSink( &attached );
+		logger.info() << "attached";
+		setSink( &sink );
+		if( reader.next( record, level ) != ShmRingReader::OK ||
+		    record.find( "attached\n" ) == std::string::npos )
+			return 1;
+	}
+	try
+	{
+		ShmRingSink other( name.c_str(), 16, 128 );
+		return 1;
+	}
+	catch( std::runtime_error & )
+	{
+	}
+
+	// A writer never waits for one of the previous lap still copying into its slot, it drops its
+	// record and completes the slot. Simulate a writer 16 that died while copying into the slot
+	// of the next record, 24, and the service restarting and attaching to the ring.
+	const int fd = shm_open( name.c_str(), O_RDWR, 0 );
+	void *mem = mmap( nullptr, 128 + 8 * 128, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+	if( mem == MAP_FAILED )
+		return 1;
+	char *slot = static_cast<char *>( mem ) + 128 + ( 24 % 8 ) * 128;
+	reinterpret_cast<std::atomic<std::uint64_t> *>( slot )->store( 2 * 16 + 1 );
+	munmap( mem, 128 + 8 * 128 );
+	{
+		ShmRingSink restarted( name.c_str(), 8, 128 );
+		setSink( &restarted );
+		// records keep flowing through that slot lap after lap
+		for( int i = 0; i < 20; ++i )
+		{
+			logger.info() << "flowing " << i;
+			const ShmRingReader::Status status = reader.next( record, level );
+			if( i == 0 ? status != ShmRingReader::OVERRUN
+			           : status != ShmRingReader::OK ||
+			                 record.find( "flowing " + std::to_string( i ) + "\n" ) == std::string::npos )
+				return 1;
+		}
+		setSink( &sink );
+		if( restarted.dropped() != 1 || reader.lost() != 13 ||
+		    reader.next( record, level ) != ShmRingReader::EMPTY )
+			return 1;
+	}
+
+	setSink( previous );
+
+	// No news are good news
+	return 0;
+}
+
+// vim: ts=4 sw=4 tw=100 noet
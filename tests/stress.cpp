@@ -0,0 +1,208 @@
+/**
+ * Stress test: many threads logging records of random size, some of them multi-line, to stdout.
+ *
+ * Stdout is redirected into a pipe. The records read from it must each appear exactly once,
+ * complete and correctly indented, in the order of their thread. The throughput of each run is
+ * reported, so this doubles as a benchmark of how logging scales with the number of threads.
+ *
+ * Usage: stress [maximum number of threads] [records per thread]
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "einhard.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace einhard;
+
+const std::size_t MAX_MESSAGE_SIZE = 2000;
+
+// A small deterministic generator, so the checker can recreate every message
+struct Random
+{
+	std::uint64_t state;
+
+	Random( unsigned thread, unsigned record ) : state( ( std::uint64_t( thread ) << 32 | record ) * 0x9e3779b97f4a7c15ull + 1 )
+	{
+	}
+	std::uint32_t operator()( std::uint32_t bound )
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return static_cast<std::uint32_t>( state % bound );
+	}
+};
+
+// The message of the given record: its identification followed by up to five lines of random text
+static std::string message( unsigned thread, unsigned record )
+{
+	Random random( thread, record );
+	std::string text = "thread " + std::to_string( thread ) + " record " + std::to_string( record );
+	const unsigned lines = random( 8 ) == 0 ? 1 + random( 5 ) : 0;
+	const std::size_t size = random( MAX_MESSAGE_SIZE );
+	for( unsigned line = 0; line <= lines; ++line )
+	{
+		text += line == 0 ? ' ' : '\n';
+		for( std::size_t i = size / ( lines + 1 ); i > 0; --i )
+		{
+			text += static_cast<char>( 'a' + random( 26 ) );
+		}
+		text += '.';
+	}
+	return text;
+}
+
+static bool startsWith( const std::string &s, std::size_t pos, const std::string &prefix )
+{
+	return s.compare( pos, prefix.size(), prefix ) == 0;
+}
+
+/*
+ * Checks the records of one run, returns an error message or an empty string.
+ */
+static std::string verify( const std::string &output, unsigned threads, unsigned records )
+{
+	const std::string header = "  INFO stress: ";
+	const std::string indent( 18 + 1 + 6, ' ' );
+	std::vector<unsigned> next( threads, 0 );
+	std::size_t pos = 0;
+	while( pos < output.size() )
+	{
+		// "[HH:MM:SS]  INFO stress: thread T record R ..."
+		if( output.size() - pos < 10 || output[pos] != '[' || output[pos + 9] != ']' ||
+		    !startsWith( output, pos + 10, header ) )
+		{
+			return "malformed record at offset " + std::to_string( pos );
+		}
+		const std::size_t begin = pos + 10 + header.size();
+		// not sscanf, which takes the length of the whole remaining output
+		char *end;
+		const unsigned thread = std::strtoul( output.c_str() + begin + 7, &end, 10 );
+		const unsigned record = std::strtoul( end + 8, nullptr, 10 );
+		if( !startsWith( output, begin, "thread " ) || !startsWith( output, end - output.c_str(), " record " ) ||
+		    thread >= threads )
+		{
+			return "unknown record at offset " + std::to_string( pos );
+		}
+		if( record != next[thread] )
+		{
+			return "thread " + std::to_string( thread ) + ": expected record " +
+			       std::to_string( next[thread] ) + ", got " + std::to_string( record );
+		}
+		++next[thread];
+
+		std::string expected = message( thread, record );
+		for( std::size_t nl = expected.find( '\n' ); nl != std::string::npos; nl = expected.find( '\n', nl + 1 ) )
+		{
+			expected.insert( nl + 1, indent );
+		}
+		expected += '\n';
+		if( !startsWith( output, begin, expected ) )
+		{
+			return "thread " + std::to_string( thread ) + ": record " + std::to_string( record ) +
+			       " is damaged";
+		}
+		pos = begin + expected.size();
+	}
+	for( unsigned thread = 0; thread < threads; ++thread )
+	{
+		if( next[thread] != records )
+		{
+			return "thread " + std::to_string( thread ) + ": " + std::to_string( next[thread] ) +
+			       " of " + std::to_string( records ) + " records";
+		}
+	}
+	return std::string();
+}
+
+int main( int argc, char **argv )
+{
+	const unsigned maxThreads = argc > 1 ? std::atoi( argv[1] ) : 64;
+	const unsigned records = argc > 2 ? std::atoi( argv[2] ) : 1000;
+
+	Logger<> logger( INFO, false );
+	logger.setAreaName( "stress" );
+
+	for( unsigned threads = 1; threads <= maxThreads; threads *= 2 )
+	{
+		// Redirect stdout into a pipe, drained by a reader thread
+		int fds[2];
+		std::fflush( stdout );
+		const int savedStdout = dup( STDOUT_FILENO );
+		if( savedStdout < 0 || pipe( fds ) != 0 || dup2( fds[1], STDOUT_FILENO ) < 0 )
+		{
+			std::perror( "redirecting stdout" );
+			return 1;
+		}
+		close( fds[1] );
+		std::string output;
+		std::thread reader( [&output, fds] {
+			char buffer[65536];
+			ssize_t size;
+			while( ( size = read( fds[0], buffer, sizeof( buffer ) ) ) > 0 )
+			{
+				output.append( buffer, size );
+			}
+		} );
+
+		const auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> writers;
+		for( unsigned thread = 0; thread < threads; ++thread )
+		{
+			writers.emplace_back( [&logger, thread, records] {
+				for( unsigned record = 0; record < records; ++record )
+				{
+					logger.info() << message( thread, record );
+				}
+			} );
+		}
+		for( std::thread &writer : writers )
+		{
+			writer.join();
+		}
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		// Restoring stdout closes the write end of the pipe, which ends the reader
+		std::fflush( stdout );
+		dup2( savedStdout, STDOUT_FILENO );
+		close( savedStdout );
+		reader.join();
+		close( fds[0] );
+
+		const std::string error = verify( output, threads, records );
+		if( !error.empty() )
+		{
+			std::fprintf( stderr, "%u threads: %s\n", threads, error.c_str() );
+			return 1;
+		}
+		std::printf( "%2u threads: %9.0f records/s, %7.1f MB/s\n", threads, threads * records / elapsed.count(),
+		             output.size() / elapsed.count() / 1e6 );
+	}
+
+	// No news are good news
+	return 0;
+}
+
+// vim: ts=4 sw=4 tw=100 noet
@@ -0,0 +1,200 @@
+/**
+ * Tests the syslog sink against a local stand-in for the syslog daemon
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "einhard.hpp"
+#include "syslogsink.hpp"
+
+#include <cstring>
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace einhard;
+
+// A datagram socket bound to a temporary path, standing in for the syslog daemon
+struct StandInServer
+{
+	std::string path;
+	int fd;
+
+	StandInServer() : path( "/tmp/einhard-syslog-" + std::to_string( getpid() ) )
+	{
+		unlink( path.c_str() );
+		fd = socket( AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0 );
+		sockaddr_un address;
+		std::memset( &address, 0, sizeof( address ) );
+		address.sun_family = AF_UNIX;
+		std::strcpy( address.sun_path, path.c_str() );
+		bind( fd, reinterpret_cast<sockaddr *>( &address ), sizeof( address ) );
+	}
+	~StandInServer()
+	{
+		close( fd );
+		unlink( path.c_str() );
+	}
+	bool receive( std::string &datagram )
+	{
+		char buffer[4096];
+		const ssize_t size = recv( fd, buffer, sizeof( buffer ), 0 );
+		if( size < 0 )
+		{
+			return false;
+		}
+		datagram.assign( buffer, size );
+		return true;
+	}
+};
+
+static bool startsWith( const std::string &s, const std::string &prefix )
+{
+	return s.compare( 0, prefix.size(), prefix ) == 0;
+}
+
+static bool endsWith( const std::string &s, const std::string &suffix )
+{
+	return s.size() >= suffix.size() && s.compare( s.size() - suffix.size(), suffix.size(), suffix ) == 0;
+}
+
+int main( int, char** )
+{
+	if( syslogSeverity( INFO ) != 6 || syslogSeverity( WARN ) != 4 || syslogSeverity( FATAL ) != 2 )
+		return 1;
+
+	StandInServer server;
+	std::string datagram;
+	Logger<> logger( INFO, true );
+	logger.setAreaName( "net" );
+
+	{
+		SyslogSink sink( "einhard-test", SyslogSink::RFC5424, server.path.c_str() );
+		setSink( &sink );
+		logger.info() << "hello " << Red() << "world";
+		logger.warn() << "careful";
+		setSink( nullptr );
+
+		if( !server.receive( datagram ) || !startsWith( datagram, "<14>1 " ) ||
+		    !endsWith( datagram, " einhard-test " + std::to_string( getpid() ) + " - - net: hello world" ) )
+			return 1;
+		if( !server.receive( datagram ) || !startsWith( datagram, "<12>1 " ) || !endsWith( datagram, "net: careful" ) )
+			return 1;
+		if( server.receive( datagram ) )
+			return 1;
+	}
+
+	{
+		// Without area the message starts right after the header, also in multi-line messages
+		SyslogSink sink( "einhard-test", SyslogSink::RFC5424, server.path.c_str() );
+		setSink( &sink );
+		Logger<> plain( INFO, true );
+		plain.info() << "no area";
+		plain.info() << "first\nsecond\n   indented";
+		logger.info() << "area\nsecond";
+		setSink( nullptr );
+
+		const std::string prefix = " einhard-test " + std::to_string( getpid() ) + " - - ";
+		if( !server.receive( datagram ) || !endsWith( datagram, prefix + "no area" ) )
+			return 1;
+		if( !server.receive( datagram ) || !endsWith( datagram, prefix + "first\nsecond\n   indented" ) )
+			return 1;
+		if( !server.receive( datagram ) || !endsWith( datagram, prefix + "net: area\nsecond" ) )
+			return 1;
+	}
+
+	{
+		// The area may contain ": ", a batch is one message keeping the headers of its later records
+		SyslogSink sink( "einhard-test", SyslogSink::RFC5424, server.path.c_str() );
+		setSink( &sink );
+		Logger<> colon( INFO, true );
+		colon.setAreaName( "a: b" );
+		colon.info() << "message\nnext";
+		{
+			Batch batch = logger.batch( INFO );
+			batch.record() << "one";
+			batch.record() << "two\nlines";
+		}
+		setSink( nullptr );
+
+		const std::string prefix = " einhard-test " + std::to_string( getpid() ) + " - - ";
+		if( !server.receive( datagram ) || !endsWith( datagram, prefix + "a: b: message\nnext" ) )
+			return 1;
+		if( !server.receive( datagram ) || datagram.find( prefix + "net: one\n[" ) == std::string::npos ||
+		    !endsWith( datagram, "]  INFO net: two\nlines" ) )
+			return 1;
+	}
+
+	{
+		SyslogSink sink( "einhard-test", SyslogSink::JOURNALD, server.path.c_str() );
+		setSink( &sink );
+		logger.error() << "single";
+		logger.error() << "multi\n  line";
+		setSink( nullptr );
+
+		if( !server.receive( datagram ) || !startsWith( datagram, "PRIORITY=3\n" ) ||
+		    datagram.find( "\nSYSLOG_IDENTIFIER=einhard-test\n" ) == std::string::npos ||
+		    !endsWith( datagram, "\nMESSAGE=net: single\n" ) )
+			return 1;
+		// continuation lines are not indented, but keep their own indent
+		const std::string message = "net: multi\n  line";
+		std::string length( 8, '\0' );
+		length[0] = static_cast<char>( message.size() );
+		if( !server.receive( datagram ) || !endsWith( datagram, "\nMESSAGE\n" + length + message + "\n" ) )
+			return 1;
+	}
+
+	{
+		// A stalled daemon must neither block the logging thread nor let the queue grow unbounded
+		SyslogSink sink( "einhard-test", SyslogSink::RFC5424, server.path.c_str(), 1, 16 );
+		setSink( &sink );
+		const int records = 5000;
+		for( int i = 0; i < records; ++i )
+		{
+			logger.info() << "record " << i;
+		}
+		setSink( nullptr );
+		if( sink.dropped() == 0 || sink.queued() > 16 )
+			return 1;
+
+		// Once the daemon catches up the queued records are delivered, the latest ones included
+		int received = 0;
+		std::string last;
+		do
+		{
+			while( server.receive( datagram ) )
+			{
+				++received;
+				last = datagram;
+			}
+		} while( !sink.flush() );
+		while( server.receive( datagram ) )
+		{
+			++received;
+			last = datagram;
+		}
+		if( sink.queued() != 0 || received + sink.dropped() != records ||
+		    !endsWith( last, "record " + std::to_string( records - 1 ) ) )
+			return 1;
+	}
+
+	// No news are good news
+	return 0;
+}
+
+// vim: ts=4 sw=4 tw=100 noet
@@ -0,0 +1,243 @@
+/**
+ * Tests tagging the records of logical tasks hopping between threads
+ *
+ * Built as C++11 and, if the compiler supports it, as C++20 to test TaskContext::await() as well.
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "einhard.hpp"
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace einhard;
+
+struct CollectingSink : public Sink
+{
+	std::mutex mutex;
+	std::vector<std::string> records;
+
+	void write( const Record &record ) noexcept override
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		records.push_back( std::string( record.data, record.size ) );
+	}
+
+	std::string last()
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		return records.empty() ? std::string() : records.back();
+	}
+};
+
+static Logger<> logger( INFO, false );
+
+static bool endsWith( const std::string &s, const std::string &suffix )
+{
+	return s.size() >= suffix.size() && s.compare( s.size() - suffix.size(), suffix.size(), suffix ) == 0;
+}
+
+#ifdef EINHARD_HAS_COROUTINES
+struct Task
+{
+	struct promise_type
+	{
+		Task get_return_object()
+		{
+			return {};
+		}
+		std::suspend_never initial_suspend() noexcept
+		{
+			return {};
+		}
+		std::suspend_never final_suspend() noexcept
+		{
+			return {};
+		}
+		void return_void()
+		{
+		}
+		void unhandled_exception()
+		{
+			std::terminate();
+		}
+	};
+};
+
+// Resumes the awaiting coroutine on a new thread, which afterwards checks that no context leaked
+struct ResumeOnNewThread
+{
+	std::thread *thread;
+	std::atomic<bool> *leaked;
+
+	bool await_ready() const noexcept
+	{
+		return false;
+	}
+	void await_suspend( std::coroutine_handle<> handle )
+	{
+		// the coroutine and this awaiter may be gone before the assignment completes
+		std::thread *const resuming = thread;
+		std::atomic<bool> *const leakedContext = leaked;
+		*resuming = std::thread( [handle, leakedContext]() {
+			handle.resume();
+			if( TaskContext::current() )
+			{
+				*leakedContext = true;
+			}
+		} );
+	}
+	void await_resume() const noexcept
+	{
+	}
+};
+
+static Task request( TaskContext &context, std::thread *first, std::thread *second, std::atomic<bool> *leaked )
+{
+	TaskContext::Scope scope( context );
+	logger.info() << "start";
+	co_await context.await( ResumeOnNewThread{first, leaked} );
+	logger.info() << "first hop";
+	// entered twice while suspended, the second thread must still end up without a context
+	TaskContext::Scope nested( context );
+	co_await context.await( ResumeOnNewThread{second, leaked} );
+	logger.info() << "second hop";
+}
+#endif
+
+int main( int, char** )
+{
+	CollectingSink sink;
+	setSink( &sink );
+	logger.setAreaName( "task" );
+
+	// Without a context nothing changes
+	logger.info() << "plain";
+	if( TaskContext::current() || !endsWith( sink.last(), " INFO task: plain\n" ) )
+		return 1;
+
+	TaskContext first( "req-1" );
+	TaskContext second( "req-2" );
+	{
+		TaskContext::Scope scope( first );
+		logger.info() << "one";
+		if( TaskContext::current() != &first || !endsWith( sink.last(), "task: [req-1] one\n" ) )
+			return 1;
+		{
+			// Nested contexts restore the outer one, entering the current one again is harmless
+			TaskContext::Scope inner( second );
+			TaskContext::Scope again( second );
+			logger.info() << "two\nlines";
+			if( !endsWith( sink.last(), "task: [req-2] two\n" + std::string( 23, ' ' ) + "lines\n" ) )
+				return 1;
+		}
+		if( TaskContext::current() != &first )
+			return 1;
+		// Batches are tagged, too
+		{
+			Batch batch = logger.batch( INFO );
+			batch.record() << "batched";
+		}
+		if( !endsWith( sink.last(), "task: [req-1] batched\n" ) )
+			return 1;
+	}
+	if( TaskContext::current() )
+		return 1;
+
+	// Entering a context again with another one in between makes it current again
+	{
+		TaskContext::Scope outer( first );
+		{
+			TaskContext::Scope middle( second );
+			{
+				TaskContext::Scope inner( first );
+				logger.info() << "re-entered";
+				if( TaskContext::current() != &first || !endsWith( sink.last(), "task: [req-1] re-entered\n" ) )
+					return 1;
+			}
+			if( TaskContext::current() != &second )
+				return 1;
+		}
+		if( TaskContext::current() != &first )
+			return 1;
+	}
+	if( TaskContext::current() )
+		return 1;
+
+	// A task continued by another thread keeps its tag, the thread's own records are untagged
+	first.enter();
+	logger.info() << "before hop";
+	first.leave();
+	std::string hopped;
+	std::string untagged;
+	std::thread( [&]() {
+		logger.info() << "not in a task";
+		untagged = sink.last();
+		TaskContext::Scope scope( first );
+		logger.info() << "after hop";
+		hopped = sink.last();
+	} ).join();
+	if( !endsWith( untagged, "task: not in a task\n" ) || !endsWith( hopped, "task: [req-1] after hop\n" ) )
+		return 1;
+
+	// The buffer of a task goes back to the pool with the task
+	const RecordBufferStats beforeTask = recordBufferStats();
+	{
+		TaskContext shortLived( "req-3" );
+		TaskContext::Scope scope( shortLived );
+		logger.info() << "short";
+	}
+	const RecordBufferStats afterTask = recordBufferStats();
+	if( afterTask.pooledBuffers != beforeTask.pooledBuffers || afterTask.buffers != beforeTask.buffers )
+		return 1;
+
+#ifdef EINHARD_HAS_COROUTINES
+	{
+		TaskContext context( "coro" );
+		std::thread firstThread;
+		std::thread secondThread;
+		std::atomic<bool> leaked( false );
+		request( context, &firstThread, &secondThread, &leaked );
+		// suspended, the context is not current on this thread anymore
+		logger.info() << "suspended";
+		if( TaskContext::current() || !endsWith( sink.last(), "task: suspended\n" ) )
+			return 1;
+		firstThread.join();
+		secondThread.join();
+		std::vector<std::string> tagged;
+		for( const std::string &record : sink.records )
+		{
+			if( record.find( "[coro]" ) != std::string::npos )
+				tagged.push_back( record );
+		}
+		if( leaked || tagged.size() != 3 || !endsWith( tagged[0], "[coro] start\n" ) ||
+		    !endsWith( tagged[1], "[coro] first hop\n" ) || !endsWith( tagged[2], "[coro] second hop\n" ) )
+			return 1;
+	}
+#endif
+
+	setSink( nullptr );
+
+	// No news are good news
+	return 0;
+}
+
+// vim: ts=4 sw=4 tw=100 noet
@@ -0,0 +1,895 @@
+/**
+ * einhard-stats: Report which areas and levels produce the records of files written by Einhard,
+ * or replay such a file through Einhard as a realistic workload.
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "einhard.hpp"
+#include "filesink.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+const long SECONDS_PER_DAY = 86400;
+// Repeated messages are identified by at most this many bytes of their first line
+const std::size_t MESSAGE_KEY_SIZE = 256;
+
+void usage( const char *argv0 )
+{
+	std::fprintf( stderr,
+	              "Usage: %s [-j THREADS] [-c SIZE] [-n TOP] FILE...\n"
+	              "       %s -r [-s SPEED] [-o OUTPUT] FILE\n"
+	              "Report the records and bytes per area, level and second of the Einhard output in\n"
+	              "FILE, e.g. to find which areas produce most of the log volume.\n\n"
+	              "  -j THREADS  parse with THREADS threads, defaults to the number of cores\n"
+	              "  -c SIZE     parse in chunks of SIZE bytes, defaults to 64 MiB\n"
+	              "  -n TOP      list the TOP most repeated messages, defaults to 10, 0 skips\n"
+	              "              looking for them, which about doubles the throughput\n"
+	              "  -r          replay the records of FILE through Einhard instead, DEBUG and TRACE\n"
+	              "              records only if einhard-stats was built without NDEBUG\n"
+	              "  -s SPEED    replay SPEED times as fast as recorded, 0 as fast as possible,\n"
+	              "              defaults to 1\n"
+	              "  -o OUTPUT   append the replayed records to OUTPUT instead of stdout\n\n"
+	              "Records are counted per second. As Einhard only logs the time of day, a jump back by\n"
+	              "more than half a day starts the next day, also between FILEs, which are taken in the\n"
+	              "order given. In messages, runs of digits are replaced by '#' to find repeated ones.\n",
+	              argv0, argv0 );
+}
+
+// A file mapped into memory
+class MappedFile
+{
+public:
+	explicit MappedFile( const char *path ) : path( path ), data( nullptr ), size( 0 )
+	{
+		const int fd = open( path, O_RDONLY | O_CLOEXEC );
+		if( fd < 0 )
+		{
+			throw std::runtime_error( std::string( path ) + ": " + std::strerror( errno ) );
+		}
+		struct stat status;
+		if( fstat( fd, &status ) == 0 && status.st_size > 0 )
+		{
+			size = static_cast<std::size_t>( status.st_size );
+			void *mapping = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+			if( mapping == MAP_FAILED )
+			{
+				const int error = errno;
+				close( fd );
+				throw std::runtime_error( std::string( path ) + ": " + std::strerror( error ) );
+			}
+			data = static_cast<const char *>( mapping );
+			madvise( mapping, size, MADV_SEQUENTIAL );
+		}
+		close( fd );
+	}
+	MappedFile( const MappedFile & ) = delete;
+	MappedFile &operator=( const MappedFile & ) = delete;
+	~MappedFile()
+	{
+		if( data )
+		{
+			munmap( const_cast<char *>( data ), size );
+		}
+	}
+
+	const char *const path;
+	const char *data;
+	std::size_t size;
+};
+
+// The parts of the first line of a record
+struct Header
+{
+	long second;  // of the day
+	einhard::LogLevel level;
+	const char *area;
+	std::size_t areaSize;
+	const char *message;  // the first line of the message, up to the newline
+	// the header without color codes, its width is the indent of continuation lines
+	const char *begin;
+	const char *end;
+};
+
+// Skips a color code like "\33[01;31m"
+const char *skipEscape( const char *it, const char *end ) noexcept
+{
+	if( it < end && *it == '\33' )
+	{
+		const char *terminator = static_cast<const char *>( std::memchr( it, 'm', end - it ) );
+		return terminator ? terminator + 1 : end;
+	}
+	return it;
+}
+
+bool isDigit( char c ) noexcept
+{
+	return c >= '0' && c <= '9';
+}
+
+bool parseTwoDigits( const char *it, long &value ) noexcept
+{
+	if( !isDigit( it[0] ) || !isDigit( it[1] ) )
+	{
+		return false;
+	}
+	value = ( it[0] - '0' ) * 10 + ( it[1] - '0' );
+	return true;
+}
+
+/*
+ * Parses a header like "[12:34:56]  INFO area: " or, without area, "[12:34:56]  INFO: ". The
+ * time separator may be any char. Colored records have color codes around the header.
+ */
+bool parseHeader( const char *line, const char *eol, Header &header ) noexcept
+{
+	const char *const start = skipEscape( line, eol );
+	const char *it = start;
+	// "[HH:MM:SS] LEVEL"
+	if( eol - it < 16 || it[0] != '[' || it[9] != ']' || it[10] != ' ' )
+	{
+		return false;
+	}
+	long hours, minutes, seconds;
+	if( !parseTwoDigits( it + 1, hours ) || !parseTwoDigits( it + 4, minutes ) ||
+	    !parseTwoDigits( it + 7, seconds ) || hours > 23 || minutes > 59 || seconds > 59 )
+	{
+		return false;
+	}
+	header.second = hours * 3600 + minutes * 60 + seconds;
+	const char *level = it + 11;
+	const char *levelEnd = it + 16;
+	while( level < levelEnd && *level == ' ' )
+	{
+		++level;
+	}
+	if( !einhard::parseLogLevel( level, levelEnd - level, header.level ) )
+	{
+		return false;
+	}
+	it = levelEnd;
+	if( *it == ' ' )
+	{
+		// the area name ends with the first ": ", area names are at most 63 bytes
+		const char *area = it + 1;
+		const char *limit = std::min( eol, area + 64 );
+		const char *colon = area;
+		while( ( colon = static_cast<const char *>( std::memchr( colon, ':', limit - colon ) ) ) &&
+		       ( colon + 1 >= eol || colon[1] != ' ' ) )
+		{
+			++colon;
+		}
+		if( !colon )
+		{
+			return false;
+		}
+		header.area = area;
+		header.areaSize = colon - area;
+		it = colon;
+	}
+	else
+	{
+		header.area = it;
+		header.areaSize = 0;
+	}
+	if( eol - it < 2 || it[0] != ':' || it[1] != ' ' )
+	{
+		return false;
+	}
+	it += 2;
+	header.begin = start;
+	header.end = it;
+	header.message = skipEscape( it, eol );
+	return true;
+}
+
+// Whether a line could start a record, much cheaper than parseHeader()
+bool mayStartRecord( const char *line, const char *end ) noexcept
+{
+	return line < end && ( *line == '[' || *line == '\33' );
+}
+
+const char *endOfLine( const char *line, const char *end ) noexcept
+{
+	const char *eol = static_cast<const char *>( std::memchr( line, '\n', end - line ) );
+	return eol ? eol : end;
+}
+
+std::uint64_t hashBytes( std::uint64_t hash, const char *data, std::size_t size ) noexcept
+{
+	for( std::size_t i = 0; i < size; ++i )
+	{
+		hash = ( hash ^ static_cast<unsigned char>( data[i] ) ) * 0x100000001b3ull;
+	}
+	return hash;
+}
+
+// Hashes 8 bytes per step, for the longer messages
+std::uint64_t hashWords( std::uint64_t hash, const char *data, std::size_t size ) noexcept
+{
+	std::size_t i = 0;
+	for( ; i + 8 <= size; i += 8 )
+	{
+		std::uint64_t word;
+		std::memcpy( &word, data + i, 8 );
+		hash = ( hash ^ word ) * 0x9e3779b97f4a7c15ull;
+		hash ^= hash >> 29;
+	}
+	return hashBytes( hash, data + i, size - i );
+}
+
+/*
+ * Copies at most MESSAGE_KEY_SIZE bytes of the message to key, replacing each run of digits by a
+ * single '#'. Returns the size of the key.
+ */
+std::size_t normalizeMessage( const char *message, std::size_t size, char *key ) noexcept
+{
+	const char *const end = message + std::min( size, MESSAGE_KEY_SIZE );
+	std::size_t keySize = 0;
+	for( const char *c = message; c < end; ++c )
+	{
+		if( isDigit( *c ) )
+		{
+			while( c + 1 < end && isDigit( c[1] ) )
+			{
+				++c;
+			}
+			key[keySize++] = '#';
+		}
+		else
+		{
+			key[keySize++] = *c;
+		}
+	}
+	return keySize;
+}
+
+std::string normalizedMessage( const char *message, std::size_t size )
+{
+	char key[MESSAGE_KEY_SIZE];
+	return std::string( key, normalizeMessage( message, size, key ) );
+}
+
+struct AreaStats
+{
+	const char *area;
+	std::size_t areaSize;
+	einhard::LogLevel level;
+	std::uint64_t records;
+	std::uint64_t bytes;
+};
+
+struct SecondStats
+{
+	std::uint64_t records;
+	std::uint64_t bytes;
+};
+
+// The seconds of the day of a chunk, in the order of its records, each run of records counted once
+typedef std::vector<std::pair<long, SecondStats>> ChunkSeconds;
+
+struct MessageStats
+{
+	const char *area;
+	std::size_t areaSize;
+	einhard::LogLevel level;
+	// the first occurrence, the strings point into the mapped files
+	const char *message;
+	std::size_t messageSize;
+	std::uint64_t records;
+};
+
+struct Stats
+{
+	std::uint64_t records = 0;
+	std::uint64_t bytes = 0;
+	// bytes before the first record of a file
+	std::uint64_t unparsed = 0;
+	std::unordered_map<std::uint64_t, AreaStats> areas;
+	std::unordered_map<std::uint64_t, MessageStats> messages;
+	// consecutive records mostly have the same area and level, skip hashing and looking them up
+	AreaStats *lastArea = nullptr;
+	std::uint64_t lastAreaHash = 0;
+
+	void add( const Header &header, const char *eol, std::size_t bytes, bool countMessages )
+	{
+		++records;
+		this->bytes += bytes;
+
+		if( !lastArea || lastArea->level != header.level || lastArea->areaSize != header.areaSize ||
+		    std::memcmp( lastArea->area, header.area, header.areaSize ) != 0 )
+		{
+			lastAreaHash = hashBytes( 0xcbf29ce484222325ull ^ header.level, header.area, header.areaSize );
+			lastArea = &areas[lastAreaHash];
+			if( lastArea->records == 0 )
+			{
+				*lastArea = {header.area, header.areaSize, header.level, 0, 0};
+			}
+		}
+		++lastArea->records;
+		lastArea->bytes += bytes;
+		const std::uint64_t areaHash = lastAreaHash;
+
+		if( countMessages )
+		{
+			char key[MESSAGE_KEY_SIZE];
+			const std::size_t keySize = normalizeMessage( header.message, eol - header.message, key );
+			MessageStats &message = messages[hashWords( areaHash, key, keySize )];
+			if( message.records == 0 )
+			{
+				message = {header.area, header.areaSize, header.level, header.message,
+				           static_cast<std::size_t>( eol - header.message ), 0};
+			}
+			++message.records;
+		}
+	}
+
+	void merge( const Stats &other )
+	{
+		records += other.records;
+		bytes += other.bytes;
+		unparsed += other.unparsed;
+		for( const std::pair<const std::uint64_t, AreaStats> &entry : other.areas )
+		{
+			AreaStats &area = areas[entry.first];
+			if( area.records == 0 )
+			{
+				area = entry.second;
+			}
+			else
+			{
+				area.records += entry.second.records;
+				area.bytes += entry.second.bytes;
+			}
+		}
+		for( const std::pair<const std::uint64_t, MessageStats> &entry : other.messages )
+		{
+			MessageStats &message = messages[entry.first];
+			if( message.records == 0 )
+			{
+				message = entry.second;
+			}
+			else
+			{
+				message.records += entry.second.records;
+			}
+		}
+	}
+};
+
+// Counts the days of records whose timestamps only give the second of the day
+struct DayCounter
+{
+	long previous = -1;
+	long day = 0;
+
+	// The second since the start of the first day
+	long unwrap( long second )
+	{
+		// a jump back by more than half a day is the next day
+		if( previous >= 0 && second + SECONDS_PER_DAY / 2 < previous )
+		{
+			++day;
+		}
+		previous = second;
+		return second + day * SECONDS_PER_DAY;
+	}
+};
+
+struct Chunk
+{
+	const MappedFile *file;
+	const char *begin;
+	const char *end;
+};
+
+/*
+ * Splits the file into chunks of about chunkSize bytes. Each chunk but the first starts with a
+ * record, so no record is split between chunks.
+ */
+void splitIntoChunks( const MappedFile &file, std::size_t chunkSize, std::vector<Chunk> &chunks )
+{
+	const char *const end = file.data + file.size;
+	const char *begin = file.data;
+	while( begin < end )
+	{
+		const char *next = begin + std::min<std::size_t>( chunkSize, end - begin );
+		if( next < end )
+		{
+			next = endOfLine( next, end );
+			next = next < end ? next + 1 : end;
+		}
+		Header header;
+		for( const char *eol; next < end; next = eol < end ? eol + 1 : end )
+		{
+			eol = endOfLine( next, end );
+			if( mayStartRecord( next, end ) && parseHeader( next, eol, header ) )
+			{
+				break;
+			}
+		}
+		chunks.push_back( {&file, begin, next} );
+		begin = next;
+	}
+}
+
+void addSecond( ChunkSeconds &seconds, long second, std::size_t bytes )
+{
+	if( seconds.empty() || seconds.back().first != second )
+	{
+		seconds.push_back( {second, {0, 0}} );
+	}
+	++seconds.back().second.records;
+	seconds.back().second.bytes += bytes;
+}
+
+void parseChunk( const Chunk &chunk, bool countMessages, Stats &stats, ChunkSeconds &seconds )
+{
+	const char *const end = chunk.end;
+	const char *line = chunk.begin;
+	bool inRecord = false;
+	Header header = {};
+	const char *firstEol = nullptr;
+	const char *recordStart = nullptr;
+	while( line < end )
+	{
+		const char *eol = endOfLine( line, end );
+		Header next;
+		if( mayStartRecord( line, end ) && parseHeader( line, eol, next ) )
+		{
+			if( inRecord )
+			{
+				stats.add( header, firstEol, line - recordStart, countMessages );
+				addSecond( seconds, header.second, line - recordStart );
+			}
+			header = next;
+			firstEol = eol;
+			recordStart = line;
+			inRecord = true;
+		}
+		else if( !inRecord )
+		{
+			stats.unparsed += ( eol < end ? eol + 1 : end ) - line;
+		}
+		line = eol < end ? eol + 1 : end;
+	}
+	if( inRecord )
+	{
+		stats.add( header, firstEol, end - recordStart, countMessages );
+		addSecond( seconds, header.second, end - recordStart );
+	}
+}
+
+// The time of a second since the start of the first day, prefixed by the day if there are several
+std::string formatSecond( long second, bool withDay )
+{
+	char text[32];
+	const long time = second % SECONDS_PER_DAY;
+	std::snprintf( text, sizeof( text ), "%02ld:%02ld:%02ld", time / 3600, time / 60 % 60, time % 60 );
+	return withDay ? "day " + std::to_string( second / SECONDS_PER_DAY + 1 ) + " " + text : text;
+}
+
+std::string formatBytes( double bytes )
+{
+	const char *const units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+	int unit = 0;
+	while( bytes >= 1024 && unit < 4 )
+	{
+		bytes /= 1024;
+		++unit;
+	}
+	char text[32];
+	std::snprintf( text, sizeof( text ), unit ? "%.1f %s" : "%.0f %s", bytes, units[unit] );
+	return text;
+}
+
+std::string areaName( const char *area, std::size_t size )
+{
+	return size ? std::string( area, size ) : std::string( "(none)" );
+}
+
+void report( const Stats &stats, const std::map<long, SecondStats> &perSecond, std::size_t top,
+             std::uint64_t fileBytes, double seconds )
+{
+	std::printf( "%llu records, %s in %.3f s (%s/s)\n", static_cast<unsigned long long>( stats.records ),
+	             formatBytes( static_cast<double>( fileBytes ) ).c_str(), seconds,
+	             formatBytes( seconds > 0 ? fileBytes / seconds : 0 ).c_str() );
+	if( stats.unparsed )
+	{
+		std::printf( "%s before the first record not in Einhard's format\n",
+		             formatBytes( static_cast<double>( stats.unparsed ) ).c_str() );
+	}
+	if( stats.records == 0 )
+	{
+		return;
+	}
+
+	const long first = perSecond.begin()->first;
+	const long last = perSecond.rbegin()->first;
+	const bool withDay = last >= SECONDS_PER_DAY;
+	std::map<long, SecondStats>::const_iterator peakRecords = perSecond.begin();
+	std::map<long, SecondStats>::const_iterator peakBytes = perSecond.begin();
+	for( std::map<long, SecondStats>::const_iterator i = perSecond.begin(); i != perSecond.end(); ++i )
+	{
+		if( i->second.records > peakRecords->second.records )
+		{
+			peakRecords = i;
+		}
+		if( i->second.bytes > peakBytes->second.bytes )
+		{
+			peakBytes = i;
+		}
+	}
+	std::printf( "\nSeconds with records: %zu between %s and %s, %.1f records/s on average\n", perSecond.size(),
+	             formatSecond( first, withDay ).c_str(), formatSecond( last, withDay ).c_str(),
+	             static_cast<double>( stats.records ) / perSecond.size() );
+	std::printf( "Peak: %llu records/s at %s, %s/s at %s\n",
+	             static_cast<unsigned long long>( peakRecords->second.records ),
+	             formatSecond( peakRecords->first, withDay ).c_str(),
+	             formatBytes( static_cast<double>( peakBytes->second.bytes ) ).c_str(),
+	             formatSecond( peakBytes->first, withDay ).c_str() );
+
+	std::vector<const AreaStats *> areas;
+	for( const std::pair<const std::uint64_t, AreaStats> &entry : stats.areas )
+	{
+		areas.push_back( &entry.second );
+	}
+	std::sort( areas.begin(), areas.end(), []( const AreaStats *a, const AreaStats *b ) {
+		return a->bytes != b->bytes ? a->bytes > b->bytes : a->records > b->records;
+	} );
+	std::printf( "\n%12s %12s %7s  %-5s  %s\n", "records", "bytes", "share", "level", "area" );
+	for( const AreaStats *area : areas )
+	{
+		std::printf( "%12llu %12s %6.2f%%  %-5s  %s\n", static_cast<unsigned long long>( area->records ),
+		             formatBytes( static_cast<double>( area->bytes ) ).c_str(), 100.0 * area->bytes / stats.bytes,
+		             einhard::getLogLevelName( area->level ), areaName( area->area, area->areaSize ).c_str() );
+	}
+
+	if( top == 0 )
+	{
+		return;
+	}
+	std::vector<const MessageStats *> messages;
+	for( const std::pair<const std::uint64_t, MessageStats> &entry : stats.messages )
+	{
+		messages.push_back( &entry.second );
+	}
+	top = std::min( top, messages.size() );
+	std::partial_sort( messages.begin(), messages.begin() + top, messages.end(),
+	                   []( const MessageStats *a, const MessageStats *b ) { return a->records > b->records; } );
+	std::printf( "\nMost repeated messages:\n%12s  %-5s  %s\n", "records", "level", "area: message" );
+	for( std::size_t i = 0; i < top; ++i )
+	{
+		const MessageStats &message = *messages[i];
+		std::printf( "%12llu  %-5s  %s: %s\n", static_cast<unsigned long long>( message.records ),
+		             einhard::getLogLevelName( message.level ), areaName( message.area, message.areaSize ).c_str(),
+		             normalizedMessage( message.message, message.messageSize ).c_str() );
+	}
+}
+
+int analyze( const std::vector<const char *> &paths, unsigned threads, std::size_t chunkSize, std::size_t top )
+{
+	const auto start = std::chrono::steady_clock::now();
+	std::vector<std::unique_ptr<MappedFile>> files;
+	std::vector<Chunk> chunks;
+	std::uint64_t fileBytes = 0;
+	for( const char *path : paths )
+	{
+		files.emplace_back( new MappedFile( path ) );
+		splitIntoChunks( *files.back(), chunkSize, chunks );
+		fileBytes += files.back()->size;
+	}
+
+	threads = std::max( 1u, std::min<unsigned>( threads, chunks.size() ) );
+	std::vector<Stats> stats( threads );
+	std::vector<ChunkSeconds> chunkSeconds( chunks.size() );
+	std::atomic<std::size_t> nextChunk( 0 );
+	const auto work = [&]( unsigned thread ) {
+		for( std::size_t i; ( i = nextChunk.fetch_add( 1 ) ) < chunks.size(); )
+		{
+			parseChunk( chunks[i], top > 0, stats[thread], chunkSeconds[i] );
+		}
+	};
+	std::vector<std::thread> workers;
+	for( unsigned i = 1; i < threads; ++i )
+	{
+		workers.emplace_back( work, i );
+	}
+	work( 0 );
+	for( std::thread &worker : workers )
+	{
+		worker.join();
+	}
+	for( unsigned i = 1; i < threads; ++i )
+	{
+		stats[0].merge( stats[i] );
+	}
+	// the chunks are in the order of the records, so the days carry over from one to the next
+	std::map<long, SecondStats> perSecond;
+	DayCounter days;
+	for( const ChunkSeconds &seconds : chunkSeconds )
+	{
+		for( const std::pair<long, SecondStats> &entry : seconds )
+		{
+			SecondStats &total = perSecond[days.unwrap( entry.first )];
+			total.records += entry.second.records;
+			total.bytes += entry.second.bytes;
+		}
+	}
+
+	const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	report( stats[0], perSecond, top, fileBytes, elapsed.count() );
+	return 0;
+}
+
+// The message of a record with the indent of its continuation lines removed
+void unindentMessage( const Header &header, const char *firstEol, const char *recordEnd, std::string &message )
+{
+	std::size_t indent = 0;
+	for( const char *c = header.begin; c < header.end; ++c )
+	{
+		// UTF-8 continuation bytes do not take a column of their own
+		indent += ( *c & 0xc0 ) != 0x80;
+	}
+	message.assign( header.message, firstEol );
+	// drop the color reset at the end of colored messages
+	if( message.size() >= 4 && message.compare( message.size() - 4, 4, "\33[0m" ) == 0 )
+	{
+		message.resize( message.size() - 4 );
+	}
+	for( const char *line = firstEol + 1; line < recordEnd; )
+	{
+		const char *eol = endOfLine( line, recordEnd );
+		const char *text = line;
+		while( text < eol && *text == ' ' && static_cast<std::size_t>( text - line ) < indent )
+		{
+			++text;
+		}
+		message += '\n';
+		message.append( text, eol );
+		line = eol + 1;
+	}
+}
+
+// Whether the record could be logged, built with NDEBUG DEBUG and TRACE records cannot
+bool logRecord( const einhard::Logger<> &logger, einhard::LogLevel level, const std::string &message )
+{
+	switch( level )
+	{
+	case einhard::ALL:
+	case einhard::TRACE:
+		logger.log<einhard::TRACE>() << message;
+		return logger.isEnabled<einhard::TRACE>();
+	case einhard::DEBUG:
+		logger.log<einhard::DEBUG>() << message;
+		return logger.isEnabled<einhard::DEBUG>();
+	case einhard::INFO:
+		logger.info() << message;
+		break;
+	case einhard::WARN:
+		logger.warn() << message;
+		break;
+	case einhard::ERROR:
+		logger.error() << message;
+		break;
+	case einhard::FATAL:
+	case einhard::OFF:
+		logger.fatal() << message;
+		break;
+	}
+	return true;
+}
+
+/*
+ * Logs the records of the file again, keeping the intervals between them divided by speed. The
+ * timestamps only have a resolution of seconds, so the records of one second are logged at once.
+ */
+int replay( const char *path, double speed, const char *outputPath )
+{
+	MappedFile file( path );
+	std::unique_ptr<einhard::FileSink> fileSink;
+	if( outputPath )
+	{
+		fileSink.reset( new einhard::FileSink( outputPath ) );
+		einhard::setSink( fileSink.get() );
+	}
+
+	std::map<std::string, std::unique_ptr<einhard::Logger<>>> loggers;
+	std::string message;
+	std::uint64_t records = 0;
+	std::uint64_t skipped = 0;
+	long firstSecond = -1;
+	DayCounter days;
+	const auto start = std::chrono::steady_clock::now();
+
+	const char *const end = file.data + file.size;
+	const char *line = file.data;
+	while( line < end )
+	{
+		const char *eol = endOfLine( line, end );
+		Header header;
+		if( !mayStartRecord( line, end ) || !parseHeader( line, eol, header ) )
+		{
+			line = eol < end ? eol + 1 : end;
+			continue;
+		}
+		// the record continues up to the next header
+		const char *recordEnd = eol;
+		while( recordEnd < end )
+		{
+			const char *next = recordEnd + 1;
+			Header ignored;
+			const char *nextEol = endOfLine( next, end );
+			if( next >= end || ( mayStartRecord( next, end ) && parseHeader( next, nextEol, ignored ) ) )
+			{
+				break;
+			}
+			recordEnd = nextEol;
+		}
+
+		const long second = days.unwrap( header.second );
+		if( firstSecond < 0 )
+		{
+			firstSecond = second;
+		}
+		if( speed > 0 )
+		{
+			std::this_thread::sleep_until(
+			    start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			                std::chrono::duration<double>( ( second - firstSecond ) / speed ) ) );
+		}
+
+		const std::string area( header.area, header.areaSize );
+		std::unique_ptr<einhard::Logger<>> &logger = loggers[area];
+		if( !logger )
+		{
+			logger.reset( new einhard::Logger<>( einhard::ALL, false ) );
+			logger->setAreaName( area );
+		}
+		unindentMessage( header, eol, recordEnd, message );
+		if( logRecord( *logger, header.level, message ) )
+		{
+			++records;
+		}
+		else
+		{
+			++skipped;
+		}
+		line = recordEnd < end ? recordEnd + 1 : end;
+	}
+
+	const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	einhard::setSink( nullptr );
+	std::fprintf( stderr, "einhard-stats: replayed %llu records in %.3f s, %.0f records/s\n",
+	              static_cast<unsigned long long>( records ), elapsed.count(),
+	              elapsed.count() > 0 ? records / elapsed.count() : 0.0 );
+	if( skipped )
+	{
+		std::fprintf( stderr, "einhard-stats: skipped %llu DEBUG and TRACE records, built with NDEBUG\n",
+		              static_cast<unsigned long long>( skipped ) );
+	}
+	return 0;
+}
+
+// Parses the argument following option i, which must be a number of at least minimum
+bool parseNumber( int argc, char **argv, int &i, double minimum, double &value )
+{
+	if( i + 1 >= argc )
+	{
+		return false;
+	}
+	char *end;
+	const char *text = argv[++i];
+	value = std::strtod( text, &end );
+	return end != text && *end == '\0' && value >= minimum;
+}
+}  // unnamed namespace
+
+int main( int argc, char **argv )
+{
+	double threads = std::max( 1u, std::thread::hardware_concurrency() );
+	double chunkSize = 64 * 1024 * 1024;
+	double top = 10;
+	bool replayMode = false;
+	double speed = 1;
+	const char *outputPath = nullptr;
+	std::vector<const char *> paths;
+	for( int i = 1; i < argc; ++i )
+	{
+		bool valid = true;
+		if( std::strcmp( argv[i], "-j" ) == 0 )
+		{
+			valid = parseNumber( argc, argv, i, 1, threads );
+		}
+		else if( std::strcmp( argv[i], "-c" ) == 0 )
+		{
+			valid = parseNumber( argc, argv, i, 1, chunkSize );
+		}
+		else if( std::strcmp( argv[i], "-n" ) == 0 )
+		{
+			valid = parseNumber( argc, argv, i, 0, top );
+		}
+		else if( std::strcmp( argv[i], "-r" ) == 0 )
+		{
+			replayMode = true;
+		}
+		else if( std::strcmp( argv[i], "-s" ) == 0 )
+		{
+			valid = parseNumber( argc, argv, i, 0, speed );
+		}
+		else if( std::strcmp( argv[i], "-o" ) == 0 && i + 1 < argc )
+		{
+			outputPath = argv[++i];
+		}
+		else if( argv[i][0] != '-' )
+		{
+			paths.push_back( argv[i] );
+		}
+		else
+		{
+			valid = false;
+		}
+		if( !valid )
+		{
+			usage( argv[0] );
+			return 2;
+		}
+	}
+	if( paths.empty() || ( replayMode && paths.size() != 1 ) )
+	{
+		usage( argv[0] );
+		return 2;
+	}
+
+	try
+	{
+		if( replayMode )
+		{
+			return replay( paths[0], speed, outputPath );
+		}
+		return analyze( paths, static_cast<unsigned>( threads ), static_cast<std::size_t>( chunkSize ),
+		                static_cast<std::size_t>( top ) );
+	}
+	catch( std::exception &e )
+	{
+		std::fprintf( stderr, "einhard-stats: %s\n", e.what() );
+		return 1;
+	}
+}
+
+// vim: ts=4 sw=4 tw=100 noet
@@ -0,0 +1,161 @@
+/**
+ * einhard-tail: Attach to the ring buffer of a ShmRingSink and write the records to a file or
+ * stdout.
+ *
+ * This file is part of Einhard.
+ *
+ * Einhard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Einhard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Einhard.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shmsink.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <thread>
+
+namespace
+{
+volatile std::sig_atomic_t s_stop = 0;
+
+void handleSignal( int )
+{
+	s_stop = 1;
+}
+
+void usage( const char *argv0 )
+{
+	std::fprintf( stderr,
+	              "Usage: %s [-f] [-n] [-p] [-o FILE] NAME\n"
+	              "Write the records of the Einhard shared memory ring buffer NAME to stdout.\n\n"
+	              "  -f       follow the ring buffer, waiting for new records\n"
+	              "  -n       only output records written after attaching\n"
+	              "  -p       remove color codes from the records\n"
+	              "  -o FILE  append the records to FILE instead of stdout\n",
+	              argv0 );
+}
+}  // unnamed namespace
+
+int main( int argc, char **argv )
+{
+	bool follow = false;
+	bool fromStart = true;
+	bool plain = false;
+	const char *outputPath = nullptr;
+	const char *name = nullptr;
+	for( int i = 1; i < argc; ++i )
+	{
+		if( std::strcmp( argv[i], "-f" ) == 0 )
+		{
+			follow = true;
+		}
+		else if( std::strcmp( argv[i], "-n" ) == 0 )
+		{
+			fromStart = false;
+		}
+		else if( std::strcmp( argv[i], "-p" ) == 0 )
+		{
+			plain = true;
+		}
+		else if( std::strcmp( argv[i], "-o" ) == 0 && i + 1 < argc )
+		{
+			outputPath = argv[++i];
+		}
+		else if( argv[i][0] != '-' && !name )
+		{
+			name = argv[i];
+		}
+		else
+		{
+			usage( argv[0] );
+			return 2;
+		}
+	}
+	if( !name )
+	{
+		usage( argv[0] );
+		return 2;
+	}
+
+	std::FILE *output = stdout;
+	if( outputPath )
+	{
+		output = std::fopen( outputPath, "ae" );
+		if( !output )
+		{
+			std::perror( outputPath );
+			return 1;
+		}
+	}
+
+	std::signal( SIGINT, handleSignal );
+	std::signal( SIGTERM, handleSignal );
+
+	try
+	{
+		einhard::ShmRingReader reader( name, fromStart );
+		std::string record;
+		std::string plainRecord;
+		einhard::LogLevel level;
+		// back off exponentially while the ring is empty to not burn a core
+		std::chrono::microseconds idle( 0 );
+		while( !s_stop )
+		{
+			switch( reader.next( record, level ) )
+			{
+			case einhard::ShmRingReader::OK:
+				if( plain )
+				{
+					einhard::Record{level, record.data(), record.size(), true, 0, 0, 0, 0}.withoutColor( plainRecord );
+					record.swap( plainRecord );
+				}
+				std::fwrite( record.data(), record.size(), 1, output );
+				idle = std::chrono::microseconds( 0 );
+				break;
+			case einhard::ShmRingReader::OVERRUN:
+				std::fprintf( stderr, "einhard-tail: overrun, %llu records lost so far\n",
+				              static_cast<unsigned long long>( reader.lost() ) );
+				break;
+			case einhard::ShmRingReader::EMPTY:
+				std::fflush( output );
+				if( !follow )
+				{
+					s_stop = 1;
+					break;
+				}
+				idle = std::min( std::max( idle * 2, std::chrono::microseconds( 100 ) ),
+				                 std::chrono::microseconds( 50000 ) );
+				std::this_thread::sleep_for( idle );
+				break;
+			}
+		}
+	}
+	catch( std::exception &e )
+	{
+		std::fprintf( stderr, "einhard-tail: %s\n", e.what() );
+		return 1;
+	}
+	std::fflush( output );
+	if( output != stdout )
+	{
+		std::fclose( output );
+	}
+	return 0;
+}
+
+// vim: ts=4 sw=4 tw=100 noet